@@ -21,6 +21,14 @@
 #include <linux/of_gpio.h>
 #include <linux/platform_device.h>
 #include <linux/firmware.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/property.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/sort.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <sound/core.h>
 #include <sound/pcm.h>
 #include <sound/pcm_params.h>
@@ -37,23 +45,203 @@
 */
 #define JACK_BTN_IRQ_GPIO 165
 
+#define RT5683_DAC_VOL_MAX	175
+#define RT5683_RAMP_MAX_MS	10000
+#define RT5683_RAMP_STEP_MS	10
+
+/* JD polling interval bounds when there is no JD IRQ */
+#define RT5683_POLL_MIN_MS	100
+#define RT5683_POLL_MAX_MS	2000
+
+/* JD IRQ storm defaults: edges per second and masked cool-down */
+#define RT5683_STORM_THRESHOLD	20
+#define RT5683_STORM_COOLDOWN_MS	5000
+
+/* Brownout sentinel check interval while the HP amp is on */
+#define RT5683_BROWNOUT_POLL_MS	1000
+
+/* Adaptive pmdown: gap history per AIF and delay bounds */
+#define RT5683_GAP_HIST		16
+#define RT5683_GAP_MIN_SAMPLES	4
+#define RT5683_PMDOWN_MIN_MS	200
+#define RT5683_PMDOWN_MAX_MS	5000
+#define RT5683_LONG_SESSION_MS	30000
+
+/* Entries of "RT5683 Control" */
+#define RT5683_MODES		6
+
+/* rt5683_priv.jd_flags */
+#define RT5683_SAR_ARMING	0
+#define RT5683_BTN_PENDING	1
+#define RT5683_JD_REMOVED	2
+
+/* Power registers shared by the mode sequences and jack detection */
+#define RT5683_PWR_REGS		6
+
+enum {
+	RT5683_BLK_VREF_FAST,
+	RT5683_BLK_VREF_SLOW,
+	RT5683_BLK_MBIAS,
+	RT5683_BLK_DAC_L,
+	RT5683_BLK_DAC_R,
+	RT5683_BLK_ADC,
+	RT5683_BLK_PUMP,
+	RT5683_BLK_CAPLESS,
+	RT5683_BLK_HP_OUT,
+	RT5683_BLK_RECMIX,
+	RT5683_BLK_SYSCLK,
+	RT5683_BLK_DAC_CLK,
+	RT5683_BLK_ADC_CLK,
+	RT5683_PWR_BLOCKS
+};
+
+struct rt5683_pwr_block {
+	const char *name;
+	unsigned int reg;
+	unsigned int mask;
+};
+
+struct rt5683_pwr_block_stat {
+	bool on;
+	unsigned long transitions;
+	u64 on_us;
+	ktime_t stamp;
+};
+
+struct rt5683_pmdown {
+	ktime_t open_stamp;
+	ktime_t close_stamp;
+	unsigned int gaps[RT5683_GAP_HIST];
+	unsigned int gap_idx;
+	unsigned int gap_cnt;
+	unsigned int delay_ms;
+	unsigned int limit_ms;
+	unsigned long hits;
+	unsigned long misses;
+};
+
+struct rt5683_lock_stat {
+	unsigned long count;
+	u64 total_us;
+	u64 max_us;
+};
+
+/*
+ * Lock domains, outermost first; a path never takes an outer lock while
+ * holding an inner one:
+ *
+ * mode_lock - power sequencing. Held across a whole "RT5683 Control"
+ *	transition (tens of ms including msleep) and by the sidetone event;
+ *	protects control, mode_override, streams, cap_voice, play_open,
+ *	aif1_dsd, sidetone_on and g_PlabackHPStatus.
+ * jd_lock - jack detection. Held by the JD/button work; protects
+ *	jack_type and jd_status. Never taken together with mode_lock, so a
+ *	plug is classified without waiting for a mode transition.
+ * pwr_lock - shared power registers (0x0062/0x0063/0x0065/0x0068/0x0214/
+ *	0x2B05). Held
+ *	for a single read-modify-write only. Each domain owns its bits in
+ *	pwr_mode/pwr_jd and the register is always written with their
+ *	union, so neither side can switch off VREF/MICBIAS the other needs.
+ * state_lock - cache state read from debugfs (DRE accounting, lock stats).
+ */
 struct rt5683_priv {
 	struct snd_soc_component *component;
+	struct i2c_client *i2c;
 	struct regmap *regmap;
 	struct snd_soc_jack *hs_jack;
 	struct delayed_work hs_btn_detect_work;
+	struct work_struct sar_arm_work;
+	struct delayed_work vol_ramp_work;
+	struct delayed_work recover_work;
+	struct delayed_work jd_poll_work;
+	struct delayed_work storm_work;
+	struct delayed_work profile_work;
+	unsigned long jd_flags;
 	int sysclk;
 	int sysclk_src;
 	int lrck;
 	int bclk;
 	int master;
 	int control;
+	int mode_override;
+	int streams[2];
+	bool cap_voice[RT5683_AIFS];
+	bool play_open[RT5683_AIFS];
+	bool aif1_dsd;
+	unsigned long mode_applied;
+	unsigned long mode_skipped;
 	int pll_src;
 	int pll_in;
 	int pll_out;
 	int g_PlabackHPStatus;
 	int jack_type;
 	int jd_status;
+	int dre_mode;
+	bool sidetone_on;
+	int hp_load;
+	int tdm_slots[RT5683_AIFS];
+	int tdm_width[RT5683_AIFS];
+	int ramp_target;
+	int ramp_ms;
+	int ramp_time;
+	int ramp_start[2];
+	int ramp_steps;
+	int ramp_step;
+	ktime_t dre_stamp;
+	u64 hp_on_us;
+	u64 dre_armed_us;
+	struct mutex mode_lock;
+	struct mutex jd_lock;
+	struct mutex pwr_lock;
+	spinlock_t state_lock;
+	unsigned int pwr_mode[RT5683_PWR_REGS];
+	unsigned int pwr_jd[RT5683_PWR_REGS];
+	struct rt5683_lock_stat mode_stat;
+	ktime_t mode_locked_at;
+	struct rt5683_lock_stat jd_stat;
+	struct rt5683_pwr_block_stat blk_stat[RT5683_PWR_BLOCKS];
+	u32 blk_ua[RT5683_PWR_BLOCKS];
+	u32 supply_uv;
+	bool suspended;
+	unsigned int voice_rate;
+	u64 mode_us[RT5683_MODES];
+	bool jd_poll;
+	unsigned int poll_ms;
+	unsigned long poll_count;
+	unsigned long poll_reads;
+	unsigned long poll_events;
+	int irq;
+	bool storm;
+	unsigned long storm_window;
+	unsigned int storm_edges;
+	u32 storm_threshold;
+	u32 storm_cooldown_ms;
+	unsigned long storm_count;
+	struct rt5683_pmdown pmdown[RT5683_AIFS];
+	unsigned long brownout_count;
+	u64 recover_last_us;
+	u64 recover_max_us;
+};
+
+static const unsigned int rt5683_pwr_regs[RT5683_PWR_REGS] = {
+	0x0062, 0x0063, 0x0065, 0x0068, 0x0214, 0x2B05,
+};
+
+/* Order matches "realtek,pwr-block-microamp" in DT */
+static const struct rt5683_pwr_block rt5683_pwr_blocks[RT5683_PWR_BLOCKS] = {
+	[RT5683_BLK_VREF_FAST]	= { "vref_fast", 0x0063, 0x8A },
+	[RT5683_BLK_VREF_SLOW]	= { "vref_slow", 0x0063, 0x50 },
+	[RT5683_BLK_MBIAS]	= { "mbias_bandgap", 0x0063, 0x24 },
+	[RT5683_BLK_DAC_L]	= { "dac_l", 0x0061, 0x01 },
+	[RT5683_BLK_DAC_R]	= { "dac_r", 0x0061, 0x02 },
+	[RT5683_BLK_ADC]	= { "adc", 0x0061, 0x20 },
+	[RT5683_BLK_PUMP]	= { "charge_pump", 0x008E, 0x10 },
+	[RT5683_BLK_CAPLESS]	= { "capless", 0x008E, 0x08 },
+	[RT5683_BLK_HP_OUT]	= { "hp_out", 0x008E, 0xE0 },
+	[RT5683_BLK_RECMIX]	= { "recmix", 0x0069, 0x80 },
+	[RT5683_BLK_SYSCLK]	= { "sysclk", 0x0208, 0x01 },
+	[RT5683_BLK_DAC_CLK]	= { "dac_clk", 0x013A, 0x10 },
+	[RT5683_BLK_ADC_CLK]	= { "adc_clk", 0x013B, 0x11 },
 };
 
 static const struct reg_default rt5683_reg[] = {
@@ -308,6 +496,137 @@ static bool rt5683_readable_register(struct device *dev, unsigned int reg)
 
 static const DECLARE_TLV_DB_SCALE(dac_vol_tlv, -65625, 375, 0);
 static const DECLARE_TLV_DB_SCALE(adc_vol_tlv, -17625, 375, 0);
+static const DECLARE_TLV_DB_SCALE(sto_dac_mix_tlv, -1800, 600, 0);
+
+static int rt5683_pwr_idx(unsigned int reg)
+{
+	int i;
+
+	for (i = 0; i < RT5683_PWR_REGS; i++)
+		if (rt5683_pwr_regs[i] == reg)
+			return i;
+
+	WARN_ON(1);
+	return 0;
+}
+
+/* Update the power-sequencing share of a shared power register */
+static void rt5683_pwr_update(struct rt5683_priv *rt5683, unsigned int reg,
+	unsigned int mask, unsigned int val)
+{
+	int i = rt5683_pwr_idx(reg);
+
+	mutex_lock(&rt5683->pwr_lock);
+	rt5683->pwr_mode[i] = (rt5683->pwr_mode[i] & ~mask) | (val & mask);
+	regmap_update_bits(rt5683->regmap, reg, mask,
+		rt5683->pwr_mode[i] | rt5683->pwr_jd[i]);
+	mutex_unlock(&rt5683->pwr_lock);
+}
+
+/* Replace the bits jack detection holds on in a shared power register */
+static void rt5683_jd_pwr_set(struct rt5683_priv *rt5683, unsigned int reg,
+	unsigned int bits)
+{
+	int i = rt5683_pwr_idx(reg);
+	unsigned int mask;
+
+	mutex_lock(&rt5683->pwr_lock);
+	mask = rt5683->pwr_jd[i] | bits;
+	rt5683->pwr_jd[i] = bits;
+	regmap_update_bits(rt5683->regmap, reg, mask,
+		rt5683->pwr_mode[i] | rt5683->pwr_jd[i]);
+	mutex_unlock(&rt5683->pwr_lock);
+}
+
+/* Called with the measured lock still held */
+static void rt5683_lock_stat_add(struct rt5683_priv *rt5683,
+	struct rt5683_lock_stat *stat, ktime_t start)
+{
+	u64 us = ktime_us_delta(ktime_get(), start);
+
+	spin_lock(&rt5683->state_lock);
+	stat->count++;
+	stat->total_us += us;
+	if (us > stat->max_us)
+		stat->max_us = us;
+	spin_unlock(&rt5683->state_lock);
+}
+
+/* mode_lock with its hold time recorded in mode_stat */
+static void rt5683_mode_lock(struct rt5683_priv *rt5683)
+{
+	mutex_lock(&rt5683->mode_lock);
+	rt5683->mode_locked_at = ktime_get();
+}
+
+static void rt5683_mode_unlock(struct rt5683_priv *rt5683)
+{
+	rt5683_lock_stat_add(rt5683, &rt5683->mode_stat,
+		rt5683->mode_locked_at);
+	mutex_unlock(&rt5683->mode_lock);
+}
+
+/*
+ * Sample the cached power bits of every tracked block. This runs after
+ * each power sequence, so toggles inside one sequence are not counted.
+ */
+static void rt5683_pwr_stats_update(struct rt5683_priv *rt5683)
+{
+	const struct rt5683_pwr_block *blk;
+	struct rt5683_pwr_block_stat *stat;
+	unsigned int val[RT5683_PWR_BLOCKS];
+	ktime_t now;
+	int i;
+
+	for (i = 0; i < RT5683_PWR_BLOCKS; i++)
+		regmap_read(rt5683->regmap, rt5683_pwr_blocks[i].reg, &val[i]);
+
+	spin_lock(&rt5683->state_lock);
+	now = ktime_get_boottime();
+	for (i = 0; i < RT5683_PWR_BLOCKS; i++) {
+		blk = &rt5683_pwr_blocks[i];
+		stat = &rt5683->blk_stat[i];
+
+		if (stat->on)
+			stat->on_us += ktime_us_delta(now, stat->stamp);
+		stat->stamp = now;
+
+		if (!!(val[i] & blk->mask) != stat->on) {
+			stat->on = !stat->on;
+			stat->transitions++;
+		}
+	}
+	spin_unlock(&rt5683->state_lock);
+}
+
+/* ADC side bits the "Sidetone" widget holds up while DAPM has it powered */
+static unsigned int rt5683_sidetone_bits(struct rt5683_priv *rt5683,
+	unsigned int reg)
+{
+	if (!rt5683->sidetone_on)
+		return 0;
+
+	switch (reg) {
+	case 0x0061:
+		return 0x20; //ADCL1
+	case 0x0069:
+		return 0x80; //RECMIX1L
+	case 0x0210:
+		return 0x80; //ADC Filter
+	case 0x013B:
+		return 0x01; //ADC1 Clock
+	default:
+		return 0;
+	}
+}
+
+/* Power off ADC side bits, leaving alone the ones the sidetone still needs */
+static void rt5683_adc_pwr_off(struct rt5683_priv *rt5683,
+	unsigned int reg, unsigned int mask)
+{
+	regmap_update_bits(rt5683->regmap, reg,
+		mask & ~rt5683_sidetone_bits(rt5683, reg), 0);
+}
 
 static void rt5683_CodecPowerBack(struct snd_soc_component *component)
 {
@@ -315,20 +634,20 @@ static void rt5683_CodecPowerBack(struct snd_soc_component *component)
 	
 	regmap_update_bits(rt5683->regmap,0x0208,0x01,0x01);//PowerON   - sysclk
 
-	regmap_update_bits(rt5683->regmap,0x0063,0xAE,0xAE); //PowerOn   - Fast VREF for performance + Enable MBIAS/Bandgap
+	rt5683_pwr_update(rt5683,0x0063,0xAE,0xAE); //PowerOn   - Fast VREF for performance + Enable MBIAS/Bandgap
 	msleep(3);
-	regmap_update_bits(rt5683->regmap,0x0063,0xFE,0xFE); //PowerOn   - Slow VREF for performance + Enable MBIAS/Bandgap
+	rt5683_pwr_update(rt5683,0x0063,0xFE,0xFE); //PowerOn   - Slow VREF for performance + Enable MBIAS/Bandgap
 	regmap_update_bits(rt5683->regmap,0x0061,0x63,0x63); //PowerOn   - LDO_DACREF/DACL1/DACR1/ADCL1
 	#ifdef FixedType
-	regmap_update_bits(rt5683->regmap,0x0062,0xCC,0xC0); //PowerOn - BST1 Power & MICBIAS1/MICBIAS2 for CBJ          
-	regmap_update_bits(rt5683->regmap,0x0065,0x61,0x61); //Keep    - LDO2/LDO_I2S 
-	regmap_update_bits(rt5683->regmap,0x0214,0xFA,0xFA); //PowerOn - HPSequence/SAR_ADC/ (Here is for depop)
+	rt5683_pwr_update(rt5683,0x0062,0xCC,0xC0); //PowerOn - BST1 Power & MICBIAS1/MICBIAS2 for CBJ          
+	rt5683_pwr_update(rt5683,0x0065,0x61,0x61); //Keep    - LDO2/LDO_I2S 
+	rt5683_pwr_update(rt5683,0x0214,0xFA,0xFA); //PowerOn - HPSequence/SAR_ADC/ (Here is for depop)
 	#else
-	regmap_update_bits(rt5683->regmap,0x0062,0x0C,0x0C); //PowerOn - MICBIAS1/MICBIAS2 for CBJ
-	regmap_update_bits(rt5683->regmap,0x0065,0xE1,0xE1); //Keep    - BJ/LDO2/LDO_I2S    
-	regmap_update_bits(rt5683->regmap,0x0214,0xFA,0xFA); //PowerOn - HPSequence/SAR_ADC/ComboJD (Here is for depop)
+	rt5683_pwr_update(rt5683,0x0062,0x0C,0x0C); //PowerOn - MICBIAS1/MICBIAS2 for CBJ
+	rt5683_pwr_update(rt5683,0x0065,0xE1,0xE1); //Keep    - BJ/LDO2/LDO_I2S    
+	rt5683_pwr_update(rt5683,0x0214,0xFA,0xFA); //PowerOn - HPSequence/SAR_ADC/ComboJD (Here is for depop)
 	#endif            
-	regmap_update_bits(rt5683->regmap,0x0068,0x03,0x03); //PowerOn   - 1M/25M OSC 
+	rt5683_pwr_update(rt5683,0x0068,0x03,0x03); //PowerOn   - 1M/25M OSC 
 	regmap_update_bits(rt5683->regmap,0x0069,0x80,0x80); //PowerOn   - RECMIX1L
 	regmap_update_bits(rt5683->regmap,0x0210,0xA3,0xA3); //PowerOn   - ADC Filter/DAC Filter/DAC Mixer
 	regmap_update_bits(rt5683->regmap,0x0211,0x01,0x01); //PowerOn   - DSP post VOL
@@ -343,51 +662,297 @@ static void rt5683_CodecPowerSaving(struct snd_soc_component *component)
 	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
 	
 	regmap_update_bits(rt5683->regmap,RT5683_HP_SIG_SRC_CTRL,Sel_hp_sig_sour1,ByRegister); //Depop
-	regmap_update_bits(rt5683->regmap,0x0063,0xFE,0x00); //PowerOFF   - Slow VREF for performance + Enable MBIAS/Bandgap
-	regmap_update_bits(rt5683->regmap,0x0061,0x63,0x00); //PowerOFF   - LDO_DACREF/DACL1/DACR1/ADCL1/ADCR1
+	rt5683_pwr_update(rt5683,0x0063,0xFE,0x00); //PowerOFF   - Slow VREF for performance + Enable MBIAS/Bandgap
+	rt5683_adc_pwr_off(rt5683,0x0061,0x63); //PowerOFF   - LDO_DACREF/DACL1/DACR1/ADCL1/ADCR1
 	#ifdef FixedType
-	regmap_update_bits(rt5683->regmap,0x0062,0xCC,0x00); //PowerOFF - BST1 Power & MICBIAS1/MICBIAS2 for CBJ
-	regmap_update_bits(rt5683->regmap,0x0065,0x61,0x61); //Keep     - LDO2/LDO_I2S
-	regmap_update_bits(rt5683->regmap,0x0214,0xFA,0x9A); //Keep     - InLine Detect Power               
+	rt5683_pwr_update(rt5683,0x0062,0xCC,0x00); //PowerOFF - BST1 Power & MICBIAS1/MICBIAS2 for CBJ
+	rt5683_pwr_update(rt5683,0x0065,0x61,0x61); //Keep     - LDO2/LDO_I2S
+	rt5683_pwr_update(rt5683,0x0214,0xFA,0x9A); //Keep     - InLine Detect Power               
 	#else
-	regmap_update_bits(rt5683->regmap,0x0062,0x0C,0x00); //PowerOFF - MICBIAS1/MICBIAS2 for CBJ
-	regmap_update_bits(rt5683->regmap,0x0065,0xE1,0xE1); //Keep     - BJ/LDO2/LDO_I2S
-	regmap_update_bits(rt5683->regmap,0x0214,0xFA,0x9A); //Keep     - InLine Detect Power               
+	rt5683_pwr_update(rt5683,0x0062,0x0C,0x00); //PowerOFF - MICBIAS1/MICBIAS2 for CBJ
+	rt5683_pwr_update(rt5683,0x0065,0xE1,0xE1); //Keep     - BJ/LDO2/LDO_I2S
+	rt5683_pwr_update(rt5683,0x0214,0xFA,0x9A); //Keep     - InLine Detect Power               
 	#endif                    
-	regmap_update_bits(rt5683->regmap,0x0068,0x03,0x03); //Keep       - 1M/25M OSC    
-	regmap_update_bits(rt5683->regmap,0x0069,0x80,0x00); //PowerOFF   - RECMIX1L
+	rt5683_pwr_update(rt5683,0x0068,0x03,0x03); //Keep       - 1M/25M OSC    
+	rt5683_adc_pwr_off(rt5683,0x0069,0x80); //PowerOFF   - RECMIX1L
 	regmap_update_bits(rt5683->regmap,0x013A,0x10,0x00); //PowerOFF   - Enable DAC Clock
-	regmap_update_bits(rt5683->regmap,0x013B,0x11,0x00); //PowerOFF   - Enable ADC1/ADC2 Clock       
+	rt5683_adc_pwr_off(rt5683,0x013B,0x11); //PowerOFF   - Enable ADC1/ADC2 Clock       
 	regmap_update_bits(rt5683->regmap,0x0208,0x01,0x00); //PowerOFF   - sysclk
-	regmap_update_bits(rt5683->regmap,0x0210,0xA3,0x00); //PowerOFF   - ADC Filter/DAC Filter/DAC Mixer
+	rt5683_adc_pwr_off(rt5683,0x0210,0xA3); //PowerOFF   - ADC Filter/DAC Filter/DAC Mixer
 	regmap_update_bits(rt5683->regmap,0x0211,0x01,0x00); //PowerOFF   - DSP post VOL
 	regmap_update_bits(rt5683->regmap,0x0213,0xC0,0x00); //PowerOFF   - Silence Detect on DA Stereo
 }
 
+/*
+ * Time the HP amp spent on with DRE armed ("HP DRE Mode" not Off). There
+ * is no readback of the gain/supply state DRE actually switched to, so
+ * this bounds the reduced-power residency rather than measuring it.
+ * Accounted whenever the HP amp state or the DRE mode is about to change,
+ * so it must be called before either is updated.
+ */
+static void __rt5683_dre_account(struct rt5683_priv *rt5683)
+{
+	ktime_t now = ktime_get_boottime();
+	s64 delta = ktime_us_delta(now, rt5683->dre_stamp);
+
+	if (rt5683->g_PlabackHPStatus) {
+		rt5683->hp_on_us += delta;
+		if (rt5683->dre_mode != RT5683_DRE_OFF)
+			rt5683->dre_armed_us += delta;
+	}
+	rt5683->dre_stamp = now;
+}
+
+static void rt5683_dre_account(struct rt5683_priv *rt5683)
+{
+	spin_lock(&rt5683->state_lock);
+	__rt5683_dre_account(rt5683);
+	spin_unlock(&rt5683->state_lock);
+}
+
+static void rt5683_dre_apply(struct rt5683_priv *rt5683)
+{
+	unsigned int val;
+
+	switch (rt5683->dre_mode) {
+	case RT5683_DRE_GAIN:
+		val = RT5683_DRE_EN | RT5683_DRE_SUP_DIS;
+		break;
+	case RT5683_DRE_GAIN_SUPPLY:
+		val = RT5683_DRE_EN | RT5683_DRE_SUP_EN;
+		break;
+	default:
+		val = RT5683_DRE_DIS | RT5683_DRE_SUP_DIS;
+		break;
+	}
+
+	regmap_update_bits(rt5683->regmap, RT5683_HP_AMP_L_DRE,
+		RT5683_DRE_EN_MASK | RT5683_DRE_SUP_MASK, val);
+	regmap_update_bits(rt5683->regmap, RT5683_HP_AMP_R_DRE,
+		RT5683_DRE_EN_MASK | RT5683_DRE_SUP_MASK, val);
+}
+
+static const char * const rt5683_dre_mode[] = {
+	"Off", "Gain", "Gain+Supply",
+};
+
+static const SOC_ENUM_SINGLE_DECL(rt5683_dre_mode_enum, 0, 0,
+	rt5683_dre_mode);
+
+static int rt5683_dre_mode_get(struct snd_kcontrol *kcontrol,
+		struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_kcontrol_chip(kcontrol);
+	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.enumerated.item[0] = rt5683->dre_mode;
+
+	return 0;
+}
+
+static int rt5683_dre_mode_put(struct snd_kcontrol *kcontrol,
+		struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_kcontrol_chip(kcontrol);
+	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
+	unsigned int mode = ucontrol->value.enumerated.item[0];
+
+	if (mode > RT5683_DRE_GAIN_SUPPLY)
+		return -EINVAL;
+
+	if (mode == rt5683->dre_mode)
+		return 0;
+
+	rt5683_mode_lock(rt5683);
+	spin_lock(&rt5683->state_lock);
+	__rt5683_dre_account(rt5683);
+	rt5683->dre_mode = mode;
+	spin_unlock(&rt5683->state_lock);
+	rt5683_dre_apply(rt5683);
+	rt5683_mode_unlock(rt5683);
+
+	return 1;
+}
+
+/*
+ * Mono voice capture: same supplies as rt5683_CodecPowerBack() for the
+ * ADC1L/BST1 path, but the DAC clock, DAC filter/mixer, DSP post volume,
+ * silence detect, ADC2 clock and the HP depop sequencer stay off.
+ */
+static void rt5683_CodecPowerVoice(struct snd_soc_component *component)
+{
+	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
+
+	regmap_update_bits(rt5683->regmap,0x0208,0x01,0x01); //PowerON   - sysclk
+
+	rt5683_pwr_update(rt5683,0x0063,0xAE,0xAE); //PowerOn   - Fast VREF for performance + Enable MBIAS/Bandgap
+	msleep(3);
+	rt5683_pwr_update(rt5683,0x0063,0xFE,0xFE); //PowerOn   - Slow VREF for performance + Enable MBIAS/Bandgap
+	regmap_update_bits(rt5683->regmap,0x0061,0x63,0x20); //PowerOn   - ADCL1 only
+	#ifdef FixedType
+	rt5683_pwr_update(rt5683,0x0062,0xCC,0xC0); //PowerOn - BST1 Power & MICBIAS1/MICBIAS2 for CBJ
+	rt5683_pwr_update(rt5683,0x0065,0x61,0x61); //Keep    - LDO2/LDO_I2S
+	#else
+	rt5683_pwr_update(rt5683,0x0062,0x0C,0x0C); //PowerOn - MICBIAS1/MICBIAS2 for CBJ
+	rt5683_pwr_update(rt5683,0x0065,0xE1,0xE1); //Keep    - BJ/LDO2/LDO_I2S
+	#endif
+	rt5683_pwr_update(rt5683,0x0214,0xFA,0x9A); //Keep    - InLine Detect Power
+	rt5683_pwr_update(rt5683,0x0068,0x03,0x03); //PowerOn   - 1M/25M OSC
+	regmap_update_bits(rt5683->regmap,0x0069,0x80,0x80); //PowerOn   - RECMIX1L
+	regmap_update_bits(rt5683->regmap,0x0210,0xA3,0x80); //PowerOn   - ADC Filter only
+	regmap_update_bits(rt5683->regmap,0x0211,0x01,0x00); //PowerOFF  - DSP post VOL
+	regmap_update_bits(rt5683->regmap,0x0213,0xC0,0x00); //PowerOFF  - Silence Detect on DA Stereo
+	regmap_update_bits(rt5683->regmap,0x013A,0x10,0x00); //PowerOFF  - DAC Clock
+	regmap_update_bits(rt5683->regmap,0x013B,0x11,0x01); //PowerOn   - ADC1 Clock only
+	msleep(5);
+}
+
+static const unsigned int rt5683_voice_rates[] = {
+	8000, 16000, 32000, 48000,
+};
+
+static const char * const rt5683_voice_rate_text[] = {
+	"8000", "16000", "32000", "48000",
+};
+
+static const SOC_ENUM_SINGLE_DECL(rt5683_voice_rate_enum, 0, 0,
+	rt5683_voice_rate_text);
+
+static int rt5683_voice_rate_get(struct snd_kcontrol *kcontrol,
+		struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_kcontrol_chip(kcontrol);
+	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.enumerated.item[0] = rt5683->voice_rate;
+
+	return 0;
+}
+
+static int rt5683_voice_rate_put(struct snd_kcontrol *kcontrol,
+		struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_kcontrol_chip(kcontrol);
+	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
+	unsigned int item = ucontrol->value.enumerated.item[0];
+
+	if (item >= ARRAY_SIZE(rt5683_voice_rates))
+		return -EINVAL;
+
+	if (item == rt5683->voice_rate)
+		return 0;
+
+	rt5683->voice_rate = item;
+
+	return 1;
+}
+
+/*
+ * Low-impedance earbuds get by with a lower buck voltage, HP amp bias and
+ * charge-pump drive. There is no impedance measurement to pick that from,
+ * so it is opt-in ("HP Load" or "realtek,hp-load"); "Auto" keeps the
+ * worst-case settings the mode sequences always used.
+ * Must be called with mode_lock held.
+ */
+static void rt5683_hp_load_apply(struct rt5683_priv *rt5683)
+{
+	if (rt5683->hp_load == RT5683_HP_LOAD_LOW) {
+		regmap_update_bits(rt5683->regmap, RT5683_BUCK_CTRL,
+			RT5683_BUCK_SEL_MASK, RT5683_BUCK_1P8V);
+		regmap_update_bits(rt5683->regmap, RT5683_HP_AMP_CTRL1,
+			RT5683_HP_AMP_BIAS_MASK, RT5683_HP_AMP_BIAS_LOW);
+		regmap_update_bits(rt5683->regmap, RT5683_HP_AMP_CTRL3,
+			RT5683_CP_MODE_MASK, RT5683_CP_MODE_LOW);
+	} else {
+		regmap_update_bits(rt5683->regmap, RT5683_BUCK_CTRL,
+			RT5683_BUCK_SEL_MASK, RT5683_BUCK_1P95V);
+		regmap_update_bits(rt5683->regmap, RT5683_HP_AMP_CTRL1,
+			RT5683_HP_AMP_BIAS_MASK, RT5683_HP_AMP_BIAS_NORMAL);
+		regmap_update_bits(rt5683->regmap, RT5683_HP_AMP_CTRL3,
+			RT5683_CP_MODE_MASK, RT5683_CP_MODE_NORMAL);
+	}
+}
+
+static const char * const rt5683_hp_load[] = {
+	"Auto", "Low Impedance", "High Impedance",
+};
+
+static const SOC_ENUM_SINGLE_DECL(rt5683_hp_load_enum, 0, 0,
+	rt5683_hp_load);
+
+static int rt5683_hp_load_get(struct snd_kcontrol *kcontrol,
+		struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_kcontrol_chip(kcontrol);
+	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.enumerated.item[0] = rt5683->hp_load;
+
+	return 0;
+}
+
+static int rt5683_hp_load_put(struct snd_kcontrol *kcontrol,
+		struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_kcontrol_chip(kcontrol);
+	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
+	unsigned int item = ucontrol->value.enumerated.item[0];
+
+	if (item > RT5683_HP_LOAD_HIGH)
+		return -EINVAL;
+
+	if (item == rt5683->hp_load)
+		return 0;
+
+	rt5683_mode_lock(rt5683);
+	rt5683->hp_load = item;
+	if (rt5683->g_PlabackHPStatus)
+		rt5683_hp_load_apply(rt5683);
+	rt5683_mode_unlock(rt5683);
+
+	return 1;
+}
+
 static const char *rt5683_ctrl_mode[] = {
 	"None", "No Playback-Record","Playback+Record", "Only Playback", "Only Record",
+	"Voice Record",
 };
 
 static const SOC_ENUM_SINGLE_DECL(rt5683_dsp_mod_enum, 0, 0,
 	rt5683_ctrl_mode);
 
-static int rt5683_control_put(struct snd_kcontrol *kcontrol,
-		struct snd_ctl_elem_value *ucontrol)
+/*
+ * Nothing else touches the codec while the HP amp just plays, so keep
+ * checking for a brownout until it is off again. Must be called with
+ * mode_lock held.
+ */
+static void rt5683_brownout_watch(struct rt5683_priv *rt5683)
+{
+	if (rt5683->g_PlabackHPStatus && !rt5683->suspended &&
+		!test_bit(RT5683_JD_REMOVED, &rt5683->jd_flags))
+		queue_delayed_work(system_power_efficient_wq,
+			&rt5683->recover_work,
+			msecs_to_jiffies(RT5683_BROWNOUT_POLL_MS));
+}
+
+/* Must be called with mode_lock held */
+static void rt5683_set_mode(struct snd_soc_component *component, int mode)
 {
-	struct snd_soc_component *component = snd_kcontrol_chip(kcontrol);
 	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
 	unsigned int silence_det;
 
-	rt5683->control = ucontrol->value.integer.value[0];
+	rt5683_dre_account(rt5683);
+	rt5683->control = mode;
 	regmap_read(rt5683->regmap, 0x1B05, &silence_det);
 
 	/**
 	* "RT5683 Control" description
-	* 0: None
+	* 0: None (automatic, follows the open AIF1/AIF2 streams)
 	* 1: No Playback +No Recording
 	* 2: Playback +Recording
 	* 3: Only Playback
 	* 4: Only Recording
+	* 5: Voice Recording (mono ADC1L only, no DAC side)
 	*/
 	if (rt5683->control == 0) {
 		pr_info("RT5683 Control None\n");
@@ -411,7 +976,7 @@ static int rt5683_control_put(struct snd_kcontrol *kcontrol,
 		rt5683_CodecPowerSaving(component);
 		regmap_update_bits(rt5683->regmap,0xFA34,0x01,0x01);  //Enable reg_en_ep_clkgat for power saving
 		regmap_update_bits(rt5683->regmap,0x0109,0x70,0x40);  //BUCK=1.95V
-		regmap_update_bits(rt5683->regmap,0x2B05,0x80,0x00);  //Disable [EN_IBUF_CBJ_BST1]  for Power Saving
+		rt5683_pwr_update(rt5683,0x2B05,0x80,0x00);  //Disable [EN_IBUF_CBJ_BST1]  for Power Saving
 		regmap_update_bits(rt5683->regmap,0x0194,0x85,0x05);   //Disable - HP Auto Mute/UnMute - On/Off by Silence Detect
 		pr_info("No Playback +No Recording\n");
 	} else if (rt5683->control == 2) {
@@ -445,8 +1010,8 @@ static int rt5683_control_put(struct snd_kcontrol *kcontrol,
 			regmap_update_bits(rt5683->regmap,0x00F9 ,0xFF,0x84); //Toggle Clear SPKVDD Auto Recovery Error Flag during Power Saving
 			msleep(1); 
 			regmap_update_bits(rt5683->regmap,0x00F9 ,0xFF,0x04);              
-			regmap_update_bits(rt5683->regmap,0x0109 ,0x70,0x40);  //BUCK=1.95V
-			regmap_update_bits(rt5683->regmap,0x2B05 ,0x80,0x80);  //Recovery [EN_IBUF_CBJ_BST1]  for Power Saving 
+			rt5683_hp_load_apply(rt5683);  //BUCK/HP bias/CP for the load
+			rt5683_pwr_update(rt5683,0x2B05,0x80,0x80);  //Recovery [EN_IBUF_CBJ_BST1]  for Power Saving 
 		if(rt5683->g_PlabackHPStatus == 0)
 		{
 			regmap_update_bits(rt5683->regmap,0x01DB,Sel_hp_sig_sour1,ByRegister);
@@ -491,14 +1056,14 @@ static int rt5683_control_put(struct snd_kcontrol *kcontrol,
 		}
 			rt5683_CodecPowerBack(component);
 			regmap_update_bits(rt5683->regmap,0xFA34,0x01,0x00); //Disable reg_en_ep_clkgat to avoid no sound issue           
-			regmap_update_bits(rt5683->regmap,0x0061,0x20,0x00);   //Power Down ADC1L
-			regmap_update_bits(rt5683->regmap,0x0069,0x80,0x00);   //Power Down RECMIX1_L
+			rt5683_adc_pwr_off(rt5683,0x0061,0x20);   //Power Down ADC1L
+			rt5683_adc_pwr_off(rt5683,0x0069,0x80);   //Power Down RECMIX1_L
 			
 			regmap_update_bits(rt5683->regmap,0x00F9 ,0xFF,0x84);  //Toggle Clear SPKVDD Auto Recovery Error Flag during Power Saving 
 			msleep(1); 
 			regmap_update_bits(rt5683->regmap,0x00F9 ,0xFF,0x04);
-			regmap_update_bits(rt5683->regmap,0x0109 ,0x70,0x40);  //BUCK=1.95V
-			regmap_update_bits(rt5683->regmap,0x2B05 ,0x80,0x00);  //Disable [EN_IBUF_CBJ_BST1]  for Power Saving 
+			rt5683_hp_load_apply(rt5683);  //BUCK/HP bias/CP for the load
+			rt5683_pwr_update(rt5683,0x2B05,0x80,0x00);  //Disable [EN_IBUF_CBJ_BST1]  for Power Saving 
 		if(rt5683->g_PlabackHPStatus == 0)
 		{
 			regmap_update_bits(rt5683->regmap,0x01BD,Sel_hp_sig_sour1,ByRegister);
@@ -544,95 +1109,868 @@ static int rt5683_control_put(struct snd_kcontrol *kcontrol,
 		regmap_update_bits(rt5683->regmap,0x0069,0x80,0x80);
 		regmap_update_bits(rt5683->regmap,0x3A00,0x80,0x80);
 		regmap_update_bits(rt5683->regmap,0x0109, 0x70,0x40);//BUCK=1.95V
-		regmap_update_bits(rt5683->regmap,0x2B05 ,0x80,0x80);//Recovery [EN_IBUF_CBJ_BST1]  for Power Saving 
+		rt5683_pwr_update(rt5683,0x2B05,0x80,0x80);//Recovery [EN_IBUF_CBJ_BST1]  for Power Saving 
 		regmap_update_bits(rt5683->regmap,0x0194,0x85,0x05);//Disable - HP Auto Mute/UnMute - On/Off by Silence Detect
 		pr_info("Only Record\n");
+	} else if (rt5683->control == 5) {
+		if(silence_det == 0x55)
+		{
+			regmap_update_bits(rt5683->regmap,0x008E,0xFF,0x00);
+			rt5683->g_PlabackHPStatus=0;
+		}
+		else
+		{
+			regmap_update_bits(rt5683->regmap,0x01DB,Sel_hp_sig_sour1,ByRegister);
+			regmap_update_bits(rt5683->regmap,0x01DC,0x04,0x04);
+			regmap_update_bits(rt5683->regmap,0x008E,0xE0,0x00); //Disable EN_OUT_HP
+			msleep(5);
+			regmap_update_bits(rt5683->regmap,0x0061,0x03,0x00); //Disable POW_DAC
+			msleep(5);
+			regmap_update_bits(rt5683->regmap,0x008E,0x08,0x00); //Disable POW_CAPLESS
+			msleep(5);
+			regmap_update_bits(rt5683->regmap,0x008E,0x10,0x00); //Disable POW_PUMP
+			msleep(5);
+			rt5683->g_PlabackHPStatus=0;
+		}
+		rt5683_CodecPowerVoice(component);
+		regmap_update_bits(rt5683->regmap,0x3A00,0x80,0x80);
+		regmap_update_bits(rt5683->regmap,0x0109,0x70,0x40);//BUCK=1.95V
+		rt5683_pwr_update(rt5683,0x2B05,0x80,0x80);//Recovery [EN_IBUF_CBJ_BST1]  for Power Saving
+		regmap_update_bits(rt5683->regmap,0x0194,0x85,0x05);//Disable - HP Auto Mute/UnMute - On/Off by Silence Detect
+		pr_info("Voice Record\n");
 	}
 
-	return 0;
-}
-
-static int rt5683_control_get(struct snd_kcontrol *kcontrol,
-		struct snd_ctl_elem_value *ucontrol)
-{
-	struct snd_soc_component *component = snd_kcontrol_chip(kcontrol);
-	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
-
-	ucontrol->value.integer.value[0] = rt5683->control;
-
-	return 0;
+	rt5683_pwr_stats_update(rt5683);
+	rt5683_brownout_watch(rt5683);
 }
 
-static const struct snd_kcontrol_new rt5683_snd_controls[] = {
-	SOC_SINGLE_TLV("DACL Playback Volume", RT5683_L_CH_VOL_DAC,
-		0, 175, 0, dac_vol_tlv),
-	SOC_SINGLE_TLV("DACR Playback Volume", RT5683_R_CH_VOL_DAC,
-		0, 175, 0, dac_vol_tlv),
-	SOC_SINGLE_TLV("ADCL Playback Volume", RT5683_L_CH_VOL_ADC,
-		0, 127, 0, adc_vol_tlv),
-	SOC_SINGLE_TLV("ADCR Playback Volume", RT5683_R_CH_VOL_ADC,
-		0, 127, 0, adc_vol_tlv),
-	SOC_ENUM_EXT("RT5683 Control", rt5683_dsp_mod_enum, rt5683_control_get,
-		rt5683_control_put),
+/*
+ * Registers whose cached value differs from reset once any mode has been
+ * applied. Reading back the reset value means the codec lost its state.
+ */
+static const struct reg_default rt5683_brownout_sentinel[] = {
+	{ 0x0065, 0x00 },
+	{ 0x0109, 0x34 },
 };
 
-static const struct snd_soc_dapm_widget rt5683_dapm_widgets[] = {
-	
-	SND_SOC_DAPM_AIF_IN("AIF1RX", "AIF1 Playback", 0, SND_SOC_NOPM, 0, 0),
-	SND_SOC_DAPM_AIF_OUT("AIF1TX", "AIF1 Capture", 0, SND_SOC_NOPM, 0, 0),
-	SND_SOC_DAPM_AIF_IN("AIF2RX", "AIF2 Playback", 0, SND_SOC_NOPM, 0, 0),
-	SND_SOC_DAPM_AIF_OUT("AIF2TX", "AIF2 Capture", 0, SND_SOC_NOPM, 0, 0),
-	SND_SOC_DAPM_INPUT("IN1P"),
-	SND_SOC_DAPM_INPUT("IN1N"),
-	SND_SOC_DAPM_INPUT("IN2P"),
-	SND_SOC_DAPM_INPUT("IN2N"),
-	SND_SOC_DAPM_OUTPUT("HPOL"),
-	SND_SOC_DAPM_OUTPUT("HPOR"),
+/* Registers restored in power-up order instead of address order */
+static const unsigned int rt5683_pwr_seq[] = {
+	0x0208, 0x0068, 0x0063, 0x0065, 0x0062, 0x0214, 0x0069, 0x0210,
+	0x0211, 0x0213, 0x013A, 0x013B,
 };
 
-static const struct snd_soc_dapm_route rt5683_dapm_routes[] = {
-	{ "AIF1TX", NULL, "IN1P" },
-	{ "AIF1TX", NULL, "IN1N" },
-	{ "AIF1TX", NULL, "IN2P" },
-	{ "AIF1TX", NULL, "IN2N" },
-	{ "AIF2TX", NULL, "IN1P" },
-	{ "AIF2TX", NULL, "IN1N" },
-	{ "AIF2TX", NULL, "IN2P" },
-	{ "AIF2TX", NULL, "IN2N" },
-	{ "HPOL", NULL, "AIF1RX" },
-	{ "HPOR", NULL, "AIF1RX" },
-	{ "HPOL", NULL, "AIF2RX" },
-	{ "HPOR", NULL, "AIF2RX" },
+/* rt5683_pwr_seq plus the HP path, sorted */
+static const unsigned int rt5683_seq_regs[] = {
+	0x0061, 0x0062, 0x0063, 0x0065, 0x0068, 0x0069, 0x008E, 0x013A,
+	0x013B, 0x01DB, 0x0208, 0x0210, 0x0211, 0x0213, 0x0214,
 };
 
-static int rt5683_probe(struct snd_soc_component *component)
+/* Read straight from the device, bypassing the register cache */
+static int rt5683_hw_read(struct rt5683_priv *rt5683, unsigned int reg,
+	unsigned int *val)
 {
-	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
+	u8 addr[2] = { reg >> 8, reg & 0xff };
+	u8 data;
+	struct i2c_msg msg[2] = {
+		{
+			.addr = rt5683->i2c->addr,
+			.len = sizeof(addr),
+			.buf = addr,
+		}, {
+			.addr = rt5683->i2c->addr,
+			.flags = I2C_M_RD,
+			.len = 1,
+			.buf = &data,
+		},
+	};
+	int ret;
 
-	rt5683->component = component;
-	rt5683->jack_type = 0;
-	rt5683->jd_status = 0x30;
+	ret = i2c_transfer(rt5683->i2c->adapter, msg, ARRAY_SIZE(msg));
+	if (ret != ARRAY_SIZE(msg))
+		return ret < 0 ? ret : -EIO;
+
+	*val = data;
 
 	return 0;
 }
 
-#ifdef CONFIG_PM
-static int rt5683_suspend(struct snd_soc_component *component)
+static bool rt5683_brownout_detected(struct rt5683_priv *rt5683)
 {
-	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
+	const struct reg_default *sentinel;
+	unsigned int cached, hw;
+	int i;
 
-	regcache_cache_only(rt5683->regmap, true);
-	regcache_mark_dirty(rt5683->regmap);
+	if (rt5683->suspended)
+		return false;
 
-	return 0;
+	for (i = 0; i < ARRAY_SIZE(rt5683_brownout_sentinel); i++) {
+		sentinel = &rt5683_brownout_sentinel[i];
+		regmap_read(rt5683->regmap, sentinel->reg, &cached);
+		if (cached == sentinel->def)
+			continue;
+		if (rt5683_hw_read(rt5683, sentinel->reg, &hw))
+			return false;
+		if (hw == sentinel->def)
+			return true;
+	}
+
+	return false;
 }
 
-static int rt5683_resume(struct snd_soc_component *component)
+/*
+ * Restore the codec from the register cache after a brownout: everything
+ * outside the power sequence first, then the supplies in power-up order,
+ * then the HP output stage the same way rt5683_set_mode() brings it up.
+ * Must be called with mode_lock held.
+ */
+static void rt5683_brownout_recover(struct rt5683_priv *rt5683)
 {
-	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
+	struct regmap *map = rt5683->regmap;
+	unsigned int min = 0, hp, hp_src;
+	ktime_t start = ktime_get();
+	u64 us;
+	int i;
+
+	dev_warn(&rt5683->i2c->dev, "Brownout detected, restoring state\n");
+
+	regcache_mark_dirty(map);
+	for (i = 0; i < ARRAY_SIZE(rt5683_seq_regs); i++) {
+		if (rt5683_seq_regs[i] > min)
+			regcache_sync_region(map, min, rt5683_seq_regs[i] - 1);
+		min = rt5683_seq_regs[i] + 1;
+	}
+	regcache_sync_region(map, min, RT5683_PHY_CTRL_27);
 
-	regcache_cache_only(rt5683->regmap, false);
-	regcache_sync(rt5683->regmap);
+	for (i = 0; i < ARRAY_SIZE(rt5683_pwr_seq); i++) {
+		regcache_sync_region(map, rt5683_pwr_seq[i], rt5683_pwr_seq[i]);
+		if (rt5683_pwr_seq[i] == 0x0063)
+			msleep(3);
+	}
+
+	regmap_read(map, 0x008E, &hp);
+	regmap_read(map, RT5683_HP_SIG_SRC_CTRL, &hp_src);
+	if (hp & 0x10) {
+		regmap_update_bits(map,RT5683_HP_SIG_SRC_CTRL,Sel_hp_sig_sour1,ByRegister);
+		regmap_write(map, 0x008E, (hp & ~0xF8) | 0x10); //Enable POW_PUMP
+		msleep(5);
+		regmap_write(map, 0x008E, (hp & ~0xF8) | 0x18); //Enable POW_CAPLESS
+		msleep(5);
+		regcache_sync_region(map, 0x0061, 0x0061); //Enable POW_DAC
+		msleep(5);
+		regmap_write(map, 0x008E, hp); //Enable EN_OUT_HP
+		msleep(5);
+		regmap_write(map, RT5683_HP_SIG_SRC_CTRL, hp_src);
+	} else {
+		regcache_sync_region(map, 0x0061, 0x0061);
+		regcache_sync_region(map, 0x008E, 0x008E);
+		regcache_sync_region(map, RT5683_HP_SIG_SRC_CTRL,
+			RT5683_HP_SIG_SRC_CTRL);
+	}
+
+	regmap_update_bits(map,0x00F9,0xFF,0x84); //Toggle Clear SPKVDD Auto Recovery Error Flag
+	msleep(1);
+	regmap_update_bits(map,0x00F9,0xFF,0x04);
+
+	us = ktime_us_delta(ktime_get(), start);
+	spin_lock(&rt5683->state_lock);
+	rt5683->brownout_count++;
+	rt5683->recover_last_us = us;
+	if (us > rt5683->recover_max_us)
+		rt5683->recover_max_us = us;
+	spin_unlock(&rt5683->state_lock);
+
+	rt5683_pwr_stats_update(rt5683);
+
+	/* The jack may have changed while the codec was out */
+	mod_delayed_work(system_power_efficient_wq,
+		&rt5683->hs_btn_detect_work, 0);
+}
+
+static void rt5683_recover_work(struct work_struct *work)
+{
+	struct rt5683_priv *rt5683 =
+		container_of(work, struct rt5683_priv, recover_work.work);
+
+	rt5683_mode_lock(rt5683);
+	if (rt5683_brownout_detected(rt5683))
+		rt5683_brownout_recover(rt5683);
+	rt5683_brownout_watch(rt5683);
+	rt5683_mode_unlock(rt5683);
+}
+
+/*
+ * Capture only gets the low-power "Voice Record" mode when every open
+ * capture stream is mono at the "Voice Record Rate". Must be called with
+ * mode_lock held.
+ */
+static int rt5683_stream_mode(struct rt5683_priv *rt5683)
+{
+	int rec_streams = rt5683->streams[SNDRV_PCM_STREAM_CAPTURE];
+	bool play = rt5683->streams[SNDRV_PCM_STREAM_PLAYBACK] > 0;
+	bool rec = rec_streams > 0;
+	bool voice = rt5683->cap_voice[RT5683_AIF1] +
+		rt5683->cap_voice[RT5683_AIF2] == rec_streams;
+
+	if (rt5683->mode_override)
+		return rt5683->mode_override;
+
+	if (play && rec)
+		return 2;
+	else if (play)
+		return 3;
+	else if (rec)
+		return voice ? 5 : 4;
+	else
+		return 1;
+}
+
+/*
+ * Move to the mode the override or the open streams ask for. Re-running
+ * the sequence for the mode already applied is skipped, unless a
+ * brownout put the codec back to its defaults. Must be called with
+ * mode_lock held.
+ */
+static void rt5683_update_mode(struct rt5683_priv *rt5683)
+{
+	int mode = rt5683_stream_mode(rt5683);
+	ktime_t start = ktime_get();
+	bool recovered = false;
+
+	if (rt5683_brownout_detected(rt5683)) {
+		rt5683_brownout_recover(rt5683);
+		recovered = true;
+	}
+
+	if (mode != rt5683->control || recovered) {
+		rt5683_set_mode(rt5683->component, mode);
+		rt5683->mode_applied++;
+		rt5683->mode_us[mode] = ktime_us_delta(ktime_get(), start);
+	} else {
+		rt5683->mode_skipped++;
+	}
+}
+
+static void rt5683_profile_work(struct work_struct *work)
+{
+	struct rt5683_priv *rt5683 =
+		container_of(work, struct rt5683_priv, profile_work.work);
+
+	rt5683_mode_lock(rt5683);
+	rt5683_update_mode(rt5683);
+	rt5683_mode_unlock(rt5683);
+}
+
+static int rt5683_control_put(struct snd_kcontrol *kcontrol,
+		struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_kcontrol_chip(kcontrol);
+	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
+	int mode = ucontrol->value.integer.value[0];
+
+	if (mode < 0 || mode >= RT5683_MODES)
+		return -EINVAL;
+
+	rt5683_mode_lock(rt5683);
+	rt5683->mode_override = mode;
+	rt5683_update_mode(rt5683);
+	rt5683_mode_unlock(rt5683);
+
+	return 0;
+}
+
+static int rt5683_control_get(struct snd_kcontrol *kcontrol,
+		struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_kcontrol_chip(kcontrol);
+	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.integer.value[0] = rt5683->mode_override;
+
+	return 0;
+}
+
+static void rt5683_vol_ramp_write(struct rt5683_priv *rt5683, int step)
+{
+	int l = rt5683->ramp_start[0], r = rt5683->ramp_start[1];
+
+	if (step < rt5683->ramp_steps) {
+		l += (rt5683->ramp_target - l) * step / rt5683->ramp_steps;
+		r += (rt5683->ramp_target - r) * step / rt5683->ramp_steps;
+	} else {
+		l = r = rt5683->ramp_target;
+	}
+
+	regmap_write(rt5683->regmap, RT5683_L_CH_VOL_DAC, l);
+	regmap_write(rt5683->regmap, RT5683_R_CH_VOL_DAC, r);
+}
+
+static void rt5683_vol_ramp_work(struct work_struct *work)
+{
+	struct rt5683_priv *rt5683 =
+		container_of(work, struct rt5683_priv, vol_ramp_work.work);
+
+	rt5683_vol_ramp_write(rt5683, ++rt5683->ramp_step);
+	if (rt5683->ramp_step < rt5683->ramp_steps)
+		queue_delayed_work(system_power_efficient_wq,
+			&rt5683->vol_ramp_work,
+			msecs_to_jiffies(rt5683->ramp_ms / rt5683->ramp_steps));
+}
+
+/* Jump straight to the target of any fade still in progress */
+static void rt5683_vol_ramp_finish(struct rt5683_priv *rt5683)
+{
+	if (cancel_delayed_work_sync(&rt5683->vol_ramp_work))
+		rt5683_vol_ramp_write(rt5683, rt5683->ramp_steps);
+}
+
+static int rt5683_vol_ramp_get(struct snd_kcontrol *kcontrol,
+		struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_kcontrol_chip(kcontrol);
+	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
+	unsigned int val;
+
+	regmap_read(rt5683->regmap, RT5683_L_CH_VOL_DAC, &val);
+	if (delayed_work_pending(&rt5683->vol_ramp_work))
+		val = rt5683->ramp_target;
+
+	ucontrol->value.integer.value[0] = val;
+
+	return 0;
+}
+
+/*
+ * Fade both DAC channels to the target volume over "DAC Volume Ramp
+ * Time". The fade is stepped from a delayed work since every step is an
+ * I2C write, with one code (0.375 dB) per step at most.
+ */
+static int rt5683_vol_ramp_put(struct snd_kcontrol *kcontrol,
+		struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_kcontrol_chip(kcontrol);
+	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
+	int target = ucontrol->value.integer.value[0];
+	int ms = rt5683->ramp_time;
+	unsigned int l, r;
+
+	if (target < 0 || target > RT5683_DAC_VOL_MAX)
+		return -EINVAL;
+
+	cancel_delayed_work_sync(&rt5683->vol_ramp_work);
+
+	regmap_read(rt5683->regmap, RT5683_L_CH_VOL_DAC, &l);
+	regmap_read(rt5683->regmap, RT5683_R_CH_VOL_DAC, &r);
+	rt5683->ramp_start[0] = l;
+	rt5683->ramp_start[1] = r;
+	rt5683->ramp_target = target;
+	rt5683->ramp_ms = ms;
+	rt5683->ramp_steps = min(max(abs(target - (int)l), abs(target - (int)r)),
+		ms / RT5683_RAMP_STEP_MS);
+	rt5683->ramp_step = 0;
+
+	if (rt5683->ramp_steps <= 1) {
+		rt5683->ramp_steps = 1;
+		rt5683_vol_ramp_write(rt5683, 1);
+		return 1;
+	}
+
+	rt5683_vol_ramp_write(rt5683, 0);
+	queue_delayed_work(system_power_efficient_wq, &rt5683->vol_ramp_work,
+		msecs_to_jiffies(ms / rt5683->ramp_steps));
+
+	return 1;
+}
+
+static int rt5683_ramp_time_get(struct snd_kcontrol *kcontrol,
+		struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_kcontrol_chip(kcontrol);
+	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.integer.value[0] = rt5683->ramp_time;
+
+	return 0;
+}
+
+/* Takes effect from the next fade; one in progress keeps its timing */
+static int rt5683_ramp_time_put(struct snd_kcontrol *kcontrol,
+		struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_kcontrol_chip(kcontrol);
+	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
+	int ms = ucontrol->value.integer.value[0];
+
+	if (ms < 0 || ms > RT5683_RAMP_MAX_MS)
+		return -EINVAL;
+
+	if (ms == rt5683->ramp_time)
+		return 0;
+
+	rt5683->ramp_time = ms;
+
+	return 1;
+}
+
+static const struct snd_kcontrol_new rt5683_snd_controls[] = {
+	SOC_SINGLE_TLV("DACL Playback Volume", RT5683_L_CH_VOL_DAC,
+		0, RT5683_DAC_VOL_MAX, 0, dac_vol_tlv),
+	SOC_SINGLE_TLV("DACR Playback Volume", RT5683_R_CH_VOL_DAC,
+		0, RT5683_DAC_VOL_MAX, 0, dac_vol_tlv),
+	SOC_SINGLE_TLV("ADCL Playback Volume", RT5683_L_CH_VOL_ADC,
+		0, 127, 0, adc_vol_tlv),
+	SOC_SINGLE_TLV("ADCR Playback Volume", RT5683_R_CH_VOL_ADC,
+		0, 127, 0, adc_vol_tlv),
+	SOC_DOUBLE_R_TLV("DAC Playback Volume", RT5683_L_CH_VOL_DAC,
+		RT5683_R_CH_VOL_DAC, 0, RT5683_DAC_VOL_MAX, 0, dac_vol_tlv),
+	SOC_DOUBLE_R_TLV("ADC Capture Volume", RT5683_L_CH_VOL_ADC,
+		RT5683_R_CH_VOL_ADC, 0, 127, 0, adc_vol_tlv),
+	SOC_SINGLE_EXT_TLV("DAC Volume Ramp", SND_SOC_NOPM, 0,
+		RT5683_DAC_VOL_MAX, 0, rt5683_vol_ramp_get, rt5683_vol_ramp_put,
+		dac_vol_tlv),
+	SOC_SINGLE_EXT("DAC Volume Ramp Time", SND_SOC_NOPM, 0,
+		RT5683_RAMP_MAX_MS, 0, rt5683_ramp_time_get,
+		rt5683_ramp_time_put),
+	SOC_SINGLE_TLV("Stereo DAC MIX AIF1 Volume", RT5683_DAC_STO1_MIX_2,
+		RT5683_STO_DAC_AIF1_GAIN_SFT, 3, 1, sto_dac_mix_tlv),
+	SOC_SINGLE_TLV("Stereo DAC MIX AIF2 Volume", RT5683_DAC_STO1_MIX_2,
+		RT5683_STO_DAC_AIF2_GAIN_SFT, 3, 1, sto_dac_mix_tlv),
+	SOC_SINGLE_TLV("Sidetone Volume", RT5683_DAC_STO1_MIX_2,
+		RT5683_STO_DAC_ST_GAIN_SFT, 3, 1, sto_dac_mix_tlv),
+	SOC_DOUBLE_R_TLV("DSD Playback Volume", RT5683_DSD_ANC_DMIX_3,
+		RT5683_DSD_ANC_DMIX_4, 0, 175, 0, dac_vol_tlv),
+	SOC_ENUM_EXT("RT5683 Control", rt5683_dsp_mod_enum, rt5683_control_get,
+		rt5683_control_put),
+	SOC_ENUM_EXT("Voice Record Rate", rt5683_voice_rate_enum,
+		rt5683_voice_rate_get, rt5683_voice_rate_put),
+	SOC_ENUM_EXT("HP Load", rt5683_hp_load_enum, rt5683_hp_load_get,
+		rt5683_hp_load_put),
+	SOC_ENUM_EXT("HP DRE Mode", rt5683_dre_mode_enum, rt5683_dre_mode_get,
+		rt5683_dre_mode_put),
+};
+
+/* Stereo DAC Mixer */
+static const struct snd_kcontrol_new rt5683_sto_dac_l_mix[] = {
+	SOC_DAPM_SINGLE("AIF1 Switch", RT5683_DAC_STO1_MIX_1,
+			RT5683_STO_DAC_AIF1_L_SFT, 1, 0),
+	SOC_DAPM_SINGLE("AIF2 Switch", RT5683_DAC_STO1_MIX_1,
+			RT5683_STO_DAC_AIF2_L_SFT, 1, 0),
+	SOC_DAPM_SINGLE("Sidetone Switch", RT5683_DAC_STO1_MIX_2,
+			RT5683_STO_DAC_ST_L_SFT, 1, 0),
+};
+
+static const struct snd_kcontrol_new rt5683_sto_dac_r_mix[] = {
+	SOC_DAPM_SINGLE("AIF1 Switch", RT5683_DAC_STO1_MIX_1,
+			RT5683_STO_DAC_AIF1_R_SFT, 1, 0),
+	SOC_DAPM_SINGLE("AIF2 Switch", RT5683_DAC_STO1_MIX_1,
+			RT5683_STO_DAC_AIF2_R_SFT, 1, 0),
+	SOC_DAPM_SINGLE("Sidetone Switch", RT5683_DAC_STO1_MIX_2,
+			RT5683_STO_DAC_ST_R_SFT, 1, 0),
+};
+
+/*
+ * The sidetone taps ADC1 straight into the stereo DAC mixer, so only the
+ * ADC front end has to be brought up on top of the playback power set.
+ * It is left on afterwards if the current mode records anyway.
+ */
+static int rt5683_sidetone_event(struct snd_soc_dapm_widget *w,
+	struct snd_kcontrol *kcontrol, int event)
+{
+	struct snd_soc_component *component =
+		snd_soc_dapm_to_component(w->dapm);
+	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
+
+	rt5683_mode_lock(rt5683);
+	switch (event) {
+	case SND_SOC_DAPM_PRE_PMU:
+		rt5683->sidetone_on = true;
+		regmap_update_bits(rt5683->regmap,0x0061,0x20,0x20); //PowerOn   - ADCL1
+		regmap_update_bits(rt5683->regmap,0x0069,0x80,0x80); //PowerOn   - RECMIX1L
+		regmap_update_bits(rt5683->regmap,0x0210,0x80,0x80); //PowerOn   - ADC Filter
+		regmap_update_bits(rt5683->regmap,0x013B,0x01,0x01); //PowerOn   - ADC1 Clock
+		break;
+
+	case SND_SOC_DAPM_POST_PMD:
+		rt5683->sidetone_on = false;
+		/* Record modes run the whole ADC side themselves */
+		if (rt5683->control == 2 || rt5683->control >= 4)
+			break;
+		regmap_update_bits(rt5683->regmap,0x0061,0x20,0x00); //PowerOFF  - ADCL1
+		regmap_update_bits(rt5683->regmap,0x0069,0x80,0x00); //PowerOFF  - RECMIX1L
+		/* "Only Playback" keeps the ADC filter/clock CodecPowerBack set */
+		if (rt5683->control == 3)
+			break;
+		regmap_update_bits(rt5683->regmap,0x0210,0x80,0x00); //PowerOFF  - ADC Filter
+		regmap_update_bits(rt5683->regmap,0x013B,0x01,0x00); //PowerOFF  - ADC1 Clock
+		break;
+
+	default:
+		break;
+	}
+	rt5683_pwr_stats_update(rt5683);
+	rt5683_mode_unlock(rt5683);
+
+	return 0;
+}
+
+static const struct snd_soc_dapm_widget rt5683_dapm_widgets[] = {
+	
+	SND_SOC_DAPM_AIF_IN("AIF1RX", "AIF1 Playback", 0, SND_SOC_NOPM, 0, 0),
+	SND_SOC_DAPM_AIF_OUT("AIF1TX", "AIF1 Capture", 0, SND_SOC_NOPM, 0, 0),
+	SND_SOC_DAPM_AIF_IN("AIF2RX", "AIF2 Playback", 0, SND_SOC_NOPM, 0, 0),
+	SND_SOC_DAPM_AIF_OUT("AIF2TX", "AIF2 Capture", 0, SND_SOC_NOPM, 0, 0),
+	SND_SOC_DAPM_INPUT("IN1P"),
+	SND_SOC_DAPM_INPUT("IN1N"),
+	SND_SOC_DAPM_INPUT("IN2P"),
+	SND_SOC_DAPM_INPUT("IN2N"),
+	SND_SOC_DAPM_ADC("ADC1", NULL, SND_SOC_NOPM, 0, 0),
+	SND_SOC_DAPM_PGA_E("Sidetone", SND_SOC_NOPM, 0, 0, NULL, 0,
+		rt5683_sidetone_event,
+		SND_SOC_DAPM_PRE_PMU | SND_SOC_DAPM_POST_PMD),
+	SND_SOC_DAPM_MIXER("Stereo DAC MIXL", SND_SOC_NOPM, 0, 0,
+		rt5683_sto_dac_l_mix, ARRAY_SIZE(rt5683_sto_dac_l_mix)),
+	SND_SOC_DAPM_MIXER("Stereo DAC MIXR", SND_SOC_NOPM, 0, 0,
+		rt5683_sto_dac_r_mix, ARRAY_SIZE(rt5683_sto_dac_r_mix)),
+	SND_SOC_DAPM_DAC("DAC L", NULL, SND_SOC_NOPM, 0, 0),
+	SND_SOC_DAPM_DAC("DAC R", NULL, SND_SOC_NOPM, 0, 0),
+	SND_SOC_DAPM_OUTPUT("HPOL"),
+	SND_SOC_DAPM_OUTPUT("HPOR"),
+};
+
+static const struct snd_soc_dapm_route rt5683_dapm_routes[] = {
+	{ "ADC1", NULL, "IN1P" },
+	{ "ADC1", NULL, "IN1N" },
+	{ "ADC1", NULL, "IN2P" },
+	{ "ADC1", NULL, "IN2N" },
+	{ "AIF1TX", NULL, "ADC1" },
+	{ "AIF2TX", NULL, "ADC1" },
+	{ "Sidetone", NULL, "ADC1" },
+	{ "Stereo DAC MIXL", "Sidetone Switch", "Sidetone" },
+	{ "Stereo DAC MIXR", "Sidetone Switch", "Sidetone" },
+	{ "Stereo DAC MIXL", "AIF1 Switch", "AIF1RX" },
+	{ "Stereo DAC MIXL", "AIF2 Switch", "AIF2RX" },
+	{ "Stereo DAC MIXR", "AIF1 Switch", "AIF1RX" },
+	{ "Stereo DAC MIXR", "AIF2 Switch", "AIF2RX" },
+	{ "DAC L", NULL, "Stereo DAC MIXL" },
+	{ "DAC R", NULL, "Stereo DAC MIXR" },
+	{ "HPOL", NULL, "DAC L" },
+	{ "HPOR", NULL, "DAC R" },
+};
+
+#ifdef CONFIG_DEBUG_FS
+static int dre_armed_residency_show(struct seq_file *s, void *data)
+{
+	struct rt5683_priv *rt5683 = s->private;
+	u64 hp_on_us, dre_armed_us, permille = 0;
+
+	spin_lock(&rt5683->state_lock);
+	__rt5683_dre_account(rt5683);
+	hp_on_us = rt5683->hp_on_us;
+	dre_armed_us = rt5683->dre_armed_us;
+	spin_unlock(&rt5683->state_lock);
+
+	if (hp_on_us)
+		permille = div64_u64(dre_armed_us * 1000, hp_on_us);
+
+	seq_printf(s, "hp_on_ms=%llu dre_armed_ms=%llu permille=%llu\n",
+		div_u64(hp_on_us, 1000), div_u64(dre_armed_us, 1000), permille);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(dre_armed_residency);
+
+static int lock_stats_show(struct seq_file *s, void *data)
+{
+	struct rt5683_priv *rt5683 = s->private;
+	struct rt5683_lock_stat mode, jd;
+
+	spin_lock(&rt5683->state_lock);
+	mode = rt5683->mode_stat;
+	jd = rt5683->jd_stat;
+	spin_unlock(&rt5683->state_lock);
+
+	seq_printf(s, "mode_lock: count=%lu total_us=%llu max_us=%llu\n"
+		"jd_lock: count=%lu total_us=%llu max_us=%llu\n",
+		mode.count, mode.total_us, mode.max_us,
+		jd.count, jd.total_us, jd.max_us);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(lock_stats);
+
+static int power_stats_show(struct seq_file *s, void *data)
+{
+	struct rt5683_priv *rt5683 = s->private;
+	struct rt5683_pwr_block_stat stat[RT5683_PWR_BLOCKS];
+	u64 uas, total_uj = 0;
+	int i;
+
+	rt5683_pwr_stats_update(rt5683);
+	spin_lock(&rt5683->state_lock);
+	memcpy(stat, rt5683->blk_stat, sizeof(stat));
+	spin_unlock(&rt5683->state_lock);
+
+	for (i = 0; i < RT5683_PWR_BLOCKS; i++) {
+		seq_printf(s, "%s: on=%d transitions=%lu on_ms=%llu",
+			rt5683_pwr_blocks[i].name, stat[i].on,
+			stat[i].transitions, div_u64(stat[i].on_us, 1000));
+
+		if (rt5683->blk_ua[i]) {
+			/* uA * us / 10^6 = uA*s, then * uV / 10^6 = uJ */
+			uas = div_u64(stat[i].on_us * rt5683->blk_ua[i],
+				1000000);
+			uas = div_u64(uas * rt5683->supply_uv, 1000000);
+			total_uj += uas;
+			seq_printf(s, " energy_uj=%llu", uas);
+		}
+		seq_printf(s, "\n");
+	}
+
+	if (total_uj)
+		seq_printf(s, "total_energy_uj=%llu\n", total_uj);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(power_stats);
+
+static int brownout_stats_show(struct seq_file *s, void *data)
+{
+	struct rt5683_priv *rt5683 = s->private;
+	unsigned long count;
+	u64 last_us, max_us;
+
+	spin_lock(&rt5683->state_lock);
+	count = rt5683->brownout_count;
+	last_us = rt5683->recover_last_us;
+	max_us = rt5683->recover_max_us;
+	spin_unlock(&rt5683->state_lock);
+
+	seq_printf(s, "count=%lu last_recover_us=%llu max_recover_us=%llu\n",
+		count, last_us, max_us);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(brownout_stats);
+
+static int mode_latency_show(struct seq_file *s, void *data)
+{
+	struct rt5683_priv *rt5683 = s->private;
+	int i;
+
+	mutex_lock(&rt5683->mode_lock);
+	for (i = 0; i < RT5683_MODES; i++)
+		seq_printf(s, "%s: %llu us\n",
+			rt5683_ctrl_mode[i], rt5683->mode_us[i]);
+	mutex_unlock(&rt5683->mode_lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(mode_latency);
+
+static int mode_profile_stats_show(struct seq_file *s, void *data)
+{
+	struct rt5683_priv *rt5683 = s->private;
+
+	mutex_lock(&rt5683->mode_lock);
+	seq_printf(s, "mode=%s override=%d playback=%d capture=%d applied=%lu skipped=%lu\n",
+		rt5683_ctrl_mode[rt5683->control], rt5683->mode_override,
+		rt5683->streams[SNDRV_PCM_STREAM_PLAYBACK],
+		rt5683->streams[SNDRV_PCM_STREAM_CAPTURE],
+		rt5683->mode_applied, rt5683->mode_skipped);
+	mutex_unlock(&rt5683->mode_lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(mode_profile_stats);
+
+static int jd_poll_stats_show(struct seq_file *s, void *data)
+{
+	struct rt5683_priv *rt5683 = s->private;
+	unsigned long count, reads, events;
+
+	spin_lock(&rt5683->state_lock);
+	count = rt5683->poll_count;
+	reads = rt5683->poll_reads;
+	events = rt5683->poll_events;
+	spin_unlock(&rt5683->state_lock);
+
+	seq_printf(s, "enabled=%d interval_ms=%u polls=%lu i2c_reads=%lu events=%lu max_reads_per_s=%u\n",
+		rt5683->jd_poll, rt5683->poll_ms, count, reads, events,
+		2 * 1000 / RT5683_POLL_MIN_MS);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(jd_poll_stats);
+
+static int jd_storm_stats_show(struct seq_file *s, void *data)
+{
+	struct rt5683_priv *rt5683 = s->private;
+
+	seq_printf(s, "threshold=%u cooldown_ms=%u active=%d storms=%lu\n",
+		rt5683->storm_threshold, rt5683->storm_cooldown_ms,
+		READ_ONCE(rt5683->storm), READ_ONCE(rt5683->storm_count));
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(jd_storm_stats);
+
+static int pmdown_stats_show(struct seq_file *s, void *data)
+{
+	struct rt5683_priv *rt5683 = s->private;
+	struct rt5683_pmdown *pm;
+	int i;
+
+	for (i = 0; i < RT5683_AIFS; i++) {
+		pm = &rt5683->pmdown[i];
+		seq_printf(s, "AIF%d: delay_ms=%u limit_ms=%u gaps=%u hits=%lu misses=%lu\n",
+			i + 1, pm->delay_ms, pm->limit_ms, pm->gap_cnt,
+			pm->hits, pm->misses);
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(pmdown_stats);
+
+static void rt5683_debugfs_init(struct rt5683_priv *rt5683,
+	struct dentry *root)
+{
+	debugfs_create_file("dre_armed_residency", 0444, root, rt5683,
+		&dre_armed_residency_fops);
+	debugfs_create_file("lock_stats", 0444, root, rt5683,
+		&lock_stats_fops);
+	debugfs_create_file("power_stats", 0444, root, rt5683,
+		&power_stats_fops);
+	debugfs_create_file("brownout_stats", 0444, root, rt5683,
+		&brownout_stats_fops);
+	debugfs_create_file("mode_latency", 0444, root, rt5683,
+		&mode_latency_fops);
+	debugfs_create_file("mode_profile_stats", 0444, root, rt5683,
+		&mode_profile_stats_fops);
+	debugfs_create_file("jd_poll_stats", 0444, root, rt5683,
+		&jd_poll_stats_fops);
+	debugfs_create_file("jd_storm_stats", 0444, root, rt5683,
+		&jd_storm_stats_fops);
+	debugfs_create_file("pmdown_stats", 0444, root, rt5683,
+		&pmdown_stats_fops);
+}
+#endif
+
+static int rt5683_probe(struct snd_soc_component *component)
+{
+	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
+
+	rt5683->component = component;
+	rt5683->jack_type = 0;
+	rt5683->jd_status = 0x30;
+
+#ifdef CONFIG_DEBUG_FS
+	rt5683_debugfs_init(rt5683, component->debugfs_root);
+#endif
+
+	/* Bound to a card again after rt5683_remove() */
+	if (test_and_clear_bit(RT5683_JD_REMOVED, &rt5683->jd_flags) &&
+		rt5683->irq)
+		enable_irq(rt5683->irq);
+
+	return 0;
+}
+
+/*
+ * Stop the JD IRQ and every work before the card frees hs_jack or the
+ * component goes away. The JD work is fenced off first, since the others
+ * (brownout recovery, SAR arming, mode changes) can requeue it.
+ */
+static void rt5683_stop(struct rt5683_priv *rt5683)
+{
+	if (test_and_set_bit(RT5683_JD_REMOVED, &rt5683->jd_flags))
+		return;
+
+	if (rt5683->irq)
+		disable_irq(rt5683->irq);
+	cancel_delayed_work_sync(&rt5683->storm_work);
+	if (rt5683->storm) {
+		WRITE_ONCE(rt5683->storm, false);
+		enable_irq(rt5683->irq);
+	}
+	cancel_delayed_work_sync(&rt5683->jd_poll_work);
+	cancel_delayed_work_sync(&rt5683->hs_btn_detect_work);
+	cancel_work_sync(&rt5683->sar_arm_work);
+	cancel_delayed_work_sync(&rt5683->recover_work);
+	cancel_delayed_work_sync(&rt5683->profile_work);
+	cancel_delayed_work_sync(&rt5683->hs_btn_detect_work);
+	cancel_delayed_work_sync(&rt5683->vol_ramp_work);
+	clear_bit(RT5683_SAR_ARMING, &rt5683->jd_flags);
+	clear_bit(RT5683_BTN_PENDING, &rt5683->jd_flags);
+	rt5683->hs_jack = NULL;
+}
+
+static void rt5683_remove(struct snd_soc_component *component)
+{
+	rt5683_stop(snd_soc_component_get_drvdata(component));
+}
+
+#ifdef CONFIG_PM
+static int rt5683_suspend(struct snd_soc_component *component)
+{
+	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
+
+	rt5683_vol_ramp_finish(rt5683);
+	flush_delayed_work(&rt5683->profile_work);
+	cancel_delayed_work_sync(&rt5683->recover_work);
+	flush_delayed_work(&rt5683->storm_work);
+	cancel_delayed_work_sync(&rt5683->jd_poll_work);
+	cancel_delayed_work_sync(&rt5683->hs_btn_detect_work);
+	cancel_work_sync(&rt5683->sar_arm_work);
+	clear_bit(RT5683_SAR_ARMING, &rt5683->jd_flags);
+	rt5683_mode_lock(rt5683);
+	rt5683->suspended = true;
+	rt5683_mode_unlock(rt5683);
+	regcache_cache_only(rt5683->regmap, true);
+	regcache_mark_dirty(rt5683->regmap);
+
+	return 0;
+}
+
+static int rt5683_resume(struct snd_soc_component *component)
+{
+	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
+	unsigned int val_00bd;
+	bool jd_same;
+
+	regcache_cache_only(rt5683->regmap, false);
+	regcache_sync(rt5683->regmap);
+	rt5683_mode_lock(rt5683);
+	rt5683->suspended = false;
+	rt5683_brownout_watch(rt5683);
+	rt5683_mode_unlock(rt5683);
+
+	/*
+	 * If the JD bits still match what was classified before suspend, the
+	 * same jack is plugged in: keep jack_type and only re-arm button
+	 * detection instead of running rt5683_headset_detect() again.
+	 */
+	mutex_lock(&rt5683->jd_lock);
+	regmap_read(rt5683->regmap, 0x00BD, &val_00bd);
+	jd_same = (val_00bd & 0x30) == (rt5683->jd_status & 0x30);
+	if (jd_same) {
+		rt5683->jd_status = val_00bd;
+		if (rt5683->jack_type == SND_JACK_HEADSET) {
+			set_bit(RT5683_SAR_ARMING, &rt5683->jd_flags);
+			queue_work(system_power_efficient_wq,
+				&rt5683->sar_arm_work);
+		}
+	}
+	mutex_unlock(&rt5683->jd_lock);
+
+	if (!jd_same)
+		mod_delayed_work(system_power_efficient_wq,
+			&rt5683->hs_btn_detect_work, 0);
+
+	if (rt5683->jd_poll && rt5683->hs_jack) {
+		rt5683->poll_ms = RT5683_POLL_MIN_MS;
+		queue_delayed_work(system_power_efficient_wq,
+			&rt5683->jd_poll_work,
+			msecs_to_jiffies(RT5683_POLL_MIN_MS));
+	}
 
 	return 0;
 }
@@ -645,6 +1983,521 @@ static int rt5683_resume(struct snd_soc_component *component)
 #define RT5683_FORMATS (SNDRV_PCM_FMTBIT_S8 | \
 			SNDRV_PCM_FMTBIT_S20_3LE | SNDRV_PCM_FMTBIT_S16_LE | \
 			SNDRV_PCM_FMTBIT_S24_LE)
+#define RT5683_AIF1_RATES (RT5683_STEREO_RATES | SNDRV_PCM_RATE_352800)
+#define RT5683_DSD_FORMATS (SNDRV_PCM_FMTBIT_DSD_U8 | \
+			SNDRV_PCM_FMTBIT_DSD_U16_LE | SNDRV_PCM_FMTBIT_DSD_U32_LE)
+#define RT5683_AIF1_FORMATS (RT5683_FORMATS | SNDRV_PCM_FMTBIT_S32_LE)
+
+/*
+ * Capture picks its mode here rather than in startup, once it is known
+ * whether the stream fits the mono "Voice Record" path.
+ */
+static void rt5683_capture_hw_params(struct rt5683_priv *rt5683,
+	struct snd_pcm_hw_params *params, int id)
+{
+	rt5683_mode_lock(rt5683);
+	rt5683->cap_voice[id] = params_channels(params) == 1 &&
+		params_rate(params) == rt5683_voice_rates[rt5683->voice_rate];
+	rt5683_update_mode(rt5683);
+	rt5683_mode_unlock(rt5683);
+}
+
+static int rt5683_aif1_hw_params(struct snd_pcm_substream *substream,
+	struct snd_pcm_hw_params *params, struct snd_soc_dai *dai)
+{
+	struct snd_soc_component *component = dai->component;
+	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
+	unsigned int val;
+	bool dsd;
+
+	switch (params_format(params)) {
+	case SNDRV_PCM_FORMAT_DSD_U8:
+	case SNDRV_PCM_FORMAT_DSD_U16_LE:
+	case SNDRV_PCM_FORMAT_DSD_U32_LE:
+		dsd = true;
+		break;
+	default:
+		dsd = false;
+		break;
+	}
+
+	if (!dsd && params_rate(params) > 192000) {
+		dev_err(component->dev, "Unsupported PCM rate %d\n",
+			params_rate(params));
+		return -EINVAL;
+	}
+
+	if (substream->stream != SNDRV_PCM_STREAM_PLAYBACK) {
+		rt5683_capture_hw_params(rt5683, params, dai->id);
+		return 0;
+	}
+
+	/*
+	 * Route the stereo DAC from the DSD path only while DSD is streamed.
+	 * That takes the DAC away from the PCM mixer, so it cannot be done
+	 * under an AIF2 stream that is already playing.
+	 */
+	rt5683_mode_lock(rt5683);
+	if (dsd && rt5683->play_open[RT5683_AIF2]) {
+		rt5683_mode_unlock(rt5683);
+		dev_err(component->dev, "DSD is not available while AIF2 plays\n");
+		return -EBUSY;
+	}
+
+	if (dsd)
+		val = RT5683_DMIX_DACL_SRC_DSD | RT5683_DMIX_DACR_SRC_DSD;
+	else
+		val = RT5683_DMIX_DACL_SRC_PCM | RT5683_DMIX_DACR_SRC_PCM;
+
+	regmap_update_bits(rt5683->regmap, RT5683_DSD_ANC_DMIX_1,
+		RT5683_DMIX_DACL_SRC_MASK | RT5683_DMIX_DACR_SRC_MASK, val);
+	rt5683->aif1_dsd = dsd;
+	rt5683_mode_unlock(rt5683);
+
+	return 0;
+}
+
+static bool rt5683_mask_has_dsd(const struct snd_mask *fmt)
+{
+	return snd_mask_test(fmt, (__force unsigned int)SNDRV_PCM_FORMAT_DSD_U8) ||
+		snd_mask_test(fmt,
+			(__force unsigned int)SNDRV_PCM_FORMAT_DSD_U16_LE) ||
+		snd_mask_test(fmt,
+			(__force unsigned int)SNDRV_PCM_FORMAT_DSD_U32_LE);
+}
+
+/* AIF1 playback above 192 kHz is DSD only */
+static int rt5683_pcm_rate_rule(struct snd_pcm_hw_params *params,
+	struct snd_pcm_hw_rule *rule)
+{
+	struct snd_interval *rate =
+		hw_param_interval(params, SNDRV_PCM_HW_PARAM_RATE);
+	struct snd_interval pcm = { .min = 0, .max = 192000 };
+
+	if (rt5683_mask_has_dsd(hw_param_mask(params,
+		SNDRV_PCM_HW_PARAM_FORMAT)))
+		return 0;
+
+	return snd_interval_refine(rate, &pcm);
+}
+
+static int rt5683_dsd_format_rule(struct snd_pcm_hw_params *params,
+	struct snd_pcm_hw_rule *rule)
+{
+	struct snd_mask *fmt = hw_param_mask(params, SNDRV_PCM_HW_PARAM_FORMAT);
+	struct snd_mask dsd;
+
+	if (hw_param_interval_c(params, SNDRV_PCM_HW_PARAM_RATE)->min <= 192000)
+		return 0;
+
+	snd_mask_none(&dsd);
+	snd_mask_set(&dsd, (__force unsigned int)SNDRV_PCM_FORMAT_DSD_U8);
+	snd_mask_set(&dsd, (__force unsigned int)SNDRV_PCM_FORMAT_DSD_U16_LE);
+	snd_mask_set(&dsd, (__force unsigned int)SNDRV_PCM_FORMAT_DSD_U32_LE);
+
+	return snd_mask_refine(fmt, &dsd);
+}
+
+static int rt5683_aif1_hw_free(struct snd_pcm_substream *substream,
+	struct snd_soc_dai *dai)
+{
+	struct snd_soc_component *component = dai->component;
+	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
+
+	if (substream->stream != SNDRV_PCM_STREAM_PLAYBACK)
+		return 0;
+
+	/* Hand the DAC back to the PCM mixer for AIF2 */
+	rt5683_mode_lock(rt5683);
+	if (rt5683->aif1_dsd) {
+		regmap_update_bits(rt5683->regmap, RT5683_DSD_ANC_DMIX_1,
+			RT5683_DMIX_DACL_SRC_MASK | RT5683_DMIX_DACR_SRC_MASK,
+			RT5683_DMIX_DACL_SRC_PCM | RT5683_DMIX_DACR_SRC_PCM);
+		rt5683->aif1_dsd = false;
+	}
+	rt5683_mode_unlock(rt5683);
+
+	return 0;
+}
+
+static int rt5683_aif2_hw_params(struct snd_pcm_substream *substream,
+	struct snd_pcm_hw_params *params, struct snd_soc_dai *dai)
+{
+	struct snd_soc_component *component = dai->component;
+	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
+
+	if (substream->stream == SNDRV_PCM_STREAM_CAPTURE)
+		rt5683_capture_hw_params(rt5683, params, dai->id);
+
+	return 0;
+}
+
+static int rt5683_set_dai_fmt(struct snd_soc_dai *dai, unsigned int fmt)
+{
+	struct snd_soc_component *component = dai->component;
+	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
+	unsigned int reg_val = 0, reg;
+
+	switch (fmt & SND_SOC_DAIFMT_MASTER_MASK) {
+	case SND_SOC_DAIFMT_CBM_CFM:
+		reg_val |= RT5683_I2S_MS_M;
+		break;
+	case SND_SOC_DAIFMT_CBS_CFS:
+		reg_val |= RT5683_I2S_MS_S;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	switch (fmt & SND_SOC_DAIFMT_INV_MASK) {
+	case SND_SOC_DAIFMT_NB_NF:
+		break;
+	case SND_SOC_DAIFMT_IB_NF:
+		reg_val |= RT5683_I2S_BP_INV;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	switch (fmt & SND_SOC_DAIFMT_FORMAT_MASK) {
+	case SND_SOC_DAIFMT_I2S:
+		reg_val |= RT5683_I2S_DF_I2S;
+		break;
+	case SND_SOC_DAIFMT_LEFT_J:
+		reg_val |= RT5683_I2S_DF_LEFT;
+		break;
+	case SND_SOC_DAIFMT_DSP_A:
+		reg_val |= RT5683_I2S_DF_PCM_A;
+		break;
+	case SND_SOC_DAIFMT_DSP_B:
+		reg_val |= RT5683_I2S_DF_PCM_B;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	switch (dai->id) {
+	case RT5683_AIF1:
+		reg = RT5683_I2S1_SDP;
+		break;
+	case RT5683_AIF2:
+		reg = RT5683_I2S2_SDP;
+		break;
+	default:
+		dev_err(component->dev, "Invalid dai->id: %d\n", dai->id);
+		return -EINVAL;
+	}
+
+	regmap_update_bits(rt5683->regmap, reg, RT5683_I2S_MS_MASK |
+		RT5683_I2S_BP_MASK | RT5683_I2S_DF_MASK, reg_val);
+	rt5683->master = !!(reg_val & RT5683_I2S_MS_M);
+
+	return 0;
+}
+
+static int rt5683_tdm_slot_sel(unsigned int mask, int slots)
+{
+	unsigned int left, right;
+
+	if (!mask)
+		return 1 << RT5683_TDM_SLOT_R_SFT;
+
+	left = __ffs(mask);
+	mask &= ~BIT(left);
+	right = mask ? __ffs(mask) : left;
+	mask &= ~BIT(right);
+	if (mask || right >= slots)
+		return -EINVAL;
+
+	return left << RT5683_TDM_SLOT_L_SFT | right << RT5683_TDM_SLOT_R_SFT;
+}
+
+static int rt5683_tdm_width_sel(int slot_width)
+{
+	switch (slot_width) {
+	case 16:
+		return 0x0;
+	case 20:
+		return 0x1;
+	case 24:
+		return 0x2;
+	case 32:
+		return 0x3;
+	default:
+		return -EINVAL;
+	}
+}
+
+static unsigned int rt5683_tdm_ctrl(struct rt5683_priv *rt5683)
+{
+	int aif = rt5683->tdm_slots[RT5683_AIF1] ? RT5683_AIF1 : RT5683_AIF2;
+	int slots = rt5683->tdm_slots[aif];
+	unsigned int val;
+
+	if (!slots)
+		return RT5683_TDM_DIS | RT5683_TDM_AIF2_SEP;
+
+	val = RT5683_TDM_EN | (slots / 2 - 1) << RT5683_TDM_SLOT_NUM_SFT |
+		rt5683_tdm_width_sel(rt5683->tdm_width[aif]) <<
+		RT5683_TDM_SLOT_WIDTH_SFT;
+	if (rt5683->tdm_slots[RT5683_AIF2])
+		val |= RT5683_TDM_AIF2_SHARE;
+
+	return val;
+}
+
+/*
+ * AIF1 and AIF2 may both be placed on the AIF1 serial bus in TDM mode, in
+ * which case they have to agree on the slot count and width and each one
+ * picks its own slots through tx_mask/rx_mask. slots == 0 takes the AIF
+ * back out of TDM mode. Since AIF2 rides on the AIF1 bus, AIF2 can only
+ * join once AIF1 is in TDM mode and AIF1 can only leave once AIF2 has.
+ */
+static int rt5683_set_tdm_slot(struct snd_soc_dai *dai, unsigned int tx_mask,
+	unsigned int rx_mask, int slots, int slot_width)
+{
+	struct snd_soc_component *component = dai->component;
+	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
+	int other, rx_sel, tx_sel;
+
+	switch (dai->id) {
+	case RT5683_AIF1:
+		other = RT5683_AIF2;
+		break;
+	case RT5683_AIF2:
+		other = RT5683_AIF1;
+		break;
+	default:
+		dev_err(component->dev, "Invalid dai->id: %d\n", dai->id);
+		return -EINVAL;
+	}
+
+	if (slots) {
+		if (slots < 2 || slots > 8 || slots % 2 ||
+			rt5683_tdm_width_sel(slot_width) < 0)
+			return -EINVAL;
+
+		if (dai->id == RT5683_AIF2 && !rt5683->tdm_slots[RT5683_AIF1]) {
+			dev_err(component->dev,
+				"AIF2 TDM needs AIF1 in TDM mode first\n");
+			return -EBUSY;
+		}
+
+		if (rt5683->tdm_slots[other] &&
+			(rt5683->tdm_slots[other] != slots ||
+			rt5683->tdm_width[other] != slot_width)) {
+			dev_err(component->dev,
+				"TDM slots/width must match the other AIF\n");
+			return -EINVAL;
+		}
+
+		rx_sel = rt5683_tdm_slot_sel(rx_mask, slots);
+		tx_sel = rt5683_tdm_slot_sel(tx_mask, slots);
+		if (rx_sel < 0 || tx_sel < 0)
+			return -EINVAL;
+
+		regmap_write(rt5683->regmap, dai->id == RT5683_AIF1 ?
+			RT5683_TDM_AIF1_RX_SLOT : RT5683_TDM_AIF2_RX_SLOT,
+			rx_sel);
+		regmap_write(rt5683->regmap, dai->id == RT5683_AIF1 ?
+			RT5683_TDM_AIF1_TX_SLOT : RT5683_TDM_AIF2_TX_SLOT,
+			tx_sel);
+	} else if (dai->id == RT5683_AIF1 && rt5683->tdm_slots[RT5683_AIF2]) {
+		dev_err(component->dev,
+			"AIF2 still shares the AIF1 TDM bus\n");
+		return -EBUSY;
+	}
+
+	rt5683->tdm_slots[dai->id] = slots;
+	rt5683->tdm_width[dai->id] = slots ? slot_width : 0;
+
+	regmap_update_bits(rt5683->regmap, RT5683_TDM_CTRL_1,
+		RT5683_TDM_EN_MASK | RT5683_TDM_AIF2_SHARE_MASK |
+		RT5683_TDM_SLOT_NUM_MASK | RT5683_TDM_SLOT_WIDTH_MASK,
+		rt5683_tdm_ctrl(rt5683));
+
+	return 0;
+}
+
+static int rt5683_gap_cmp(const void *a, const void *b)
+{
+	unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Pick the pmdown delay for the stream being closed: stay powered across
+ * the 75th percentile of recently observed reopen gaps, unless that is
+ * longer than keeping the codec up is worth, or the stream that just
+ * ended was a long session (media) that is unlikely to be followed soon.
+ */
+static unsigned int rt5683_pmdown_delay(struct rt5683_pmdown *pm,
+	s64 session_ms)
+{
+	unsigned int gaps[RT5683_GAP_HIST], p75;
+
+	if (session_ms >= RT5683_LONG_SESSION_MS)
+		return RT5683_PMDOWN_MIN_MS;
+
+	memcpy(gaps, pm->gaps, sizeof(gaps));
+	sort(gaps, pm->gap_cnt, sizeof(gaps[0]), rt5683_gap_cmp, NULL);
+	p75 = gaps[(pm->gap_cnt * 3) / 4];
+	if (p75 > RT5683_PMDOWN_MAX_MS)
+		return RT5683_PMDOWN_MIN_MS;
+
+	return clamp_t(unsigned int, p75 + p75 / 4, RT5683_PMDOWN_MIN_MS,
+		RT5683_PMDOWN_MAX_MS);
+}
+
+static void rt5683_pmdown_open(struct rt5683_pmdown *pm)
+{
+	ktime_t now = ktime_get();
+	unsigned int gap;
+
+	if (pm->close_stamp) {
+		gap = min_t(s64, ktime_ms_delta(now, pm->close_stamp), UINT_MAX);
+		pm->gaps[pm->gap_idx] = gap;
+		pm->gap_idx = (pm->gap_idx + 1) % RT5683_GAP_HIST;
+		if (pm->gap_cnt < RT5683_GAP_HIST)
+			pm->gap_cnt++;
+
+		if (gap < pm->delay_ms)
+			pm->hits++;
+		else
+			pm->misses++;
+	}
+
+	pm->open_stamp = now;
+}
+
+static void rt5683_pmdown_close(struct rt5683_pmdown *pm,
+	struct snd_soc_pcm_runtime *rtd)
+{
+	ktime_t now = ktime_get();
+
+	/*
+	 * The link's pmdown_time (machine driver or its sysfs attribute) is
+	 * the upper bound. Anything other than what was last written here
+	 * is a new setting from outside.
+	 */
+	if (rtd->pmdown_time != pm->delay_ms)
+		pm->limit_ms = rtd->pmdown_time;
+
+	pm->delay_ms = pm->limit_ms;
+	if (pm->gap_cnt >= RT5683_GAP_MIN_SAMPLES)
+		pm->delay_ms = min(rt5683_pmdown_delay(pm,
+			ktime_ms_delta(now, pm->open_stamp)), pm->limit_ms);
+
+	rtd->pmdown_time = pm->delay_ms;
+	pm->close_stamp = now;
+}
+
+static int rt5683_dai_startup(struct snd_pcm_substream *substream,
+	struct snd_soc_dai *dai)
+{
+	struct snd_soc_component *component = dai->component;
+	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
+	int ret;
+
+	/* A pinned "Voice Record" mode only powers the mono ADC1L path */
+	if (substream->stream == SNDRV_PCM_STREAM_CAPTURE &&
+		READ_ONCE(rt5683->mode_override) == 5) {
+		ret = snd_pcm_hw_constraint_single(substream->runtime,
+			SNDRV_PCM_HW_PARAM_RATE,
+			rt5683_voice_rates[rt5683->voice_rate]);
+		if (ret < 0)
+			return ret;
+
+		ret = snd_pcm_hw_constraint_single(substream->runtime,
+			SNDRV_PCM_HW_PARAM_CHANNELS, 1);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK &&
+		dai->id == RT5683_AIF1) {
+		ret = snd_pcm_hw_rule_add(substream->runtime, 0,
+			SNDRV_PCM_HW_PARAM_RATE, rt5683_pcm_rate_rule, NULL,
+			SNDRV_PCM_HW_PARAM_FORMAT, -1);
+		if (ret < 0)
+			return ret;
+
+		ret = snd_pcm_hw_rule_add(substream->runtime, 0,
+			SNDRV_PCM_HW_PARAM_FORMAT, rt5683_dsd_format_rule, NULL,
+			SNDRV_PCM_HW_PARAM_RATE, -1);
+		if (ret < 0)
+			return ret;
+	}
+
+	/*
+	 * Only count the stream once nothing above can fail: 4.19 does not
+	 * call shutdown for a DAI whose startup failed. Playback powers up
+	 * here, capture in rt5683_capture_hw_params().
+	 */
+	rt5683_mode_lock(rt5683);
+	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK &&
+		dai->id == RT5683_AIF2 && rt5683->aif1_dsd) {
+		rt5683_mode_unlock(rt5683);
+		dev_err(component->dev, "AIF2 playback blocked by AIF1 DSD\n");
+		return -EBUSY;
+	}
+
+	cancel_delayed_work(&rt5683->profile_work);
+	rt5683->streams[substream->stream]++;
+	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK) {
+		rt5683->play_open[dai->id] = true;
+		rt5683_update_mode(rt5683);
+	}
+	rt5683_mode_unlock(rt5683);
+
+	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK)
+		rt5683_pmdown_open(&rt5683->pmdown[dai->id]);
+
+	return 0;
+}
+
+static void rt5683_dai_shutdown(struct snd_pcm_substream *substream,
+	struct snd_soc_dai *dai)
+{
+	struct snd_soc_component *component = dai->component;
+	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
+	struct snd_soc_pcm_runtime *rtd = substream->private_data;
+
+	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK)
+		rt5683_pmdown_close(&rt5683->pmdown[dai->id], rtd);
+
+	/*
+	 * Power down no sooner than DAPM does, so a stream reopened within
+	 * pmdown_time keeps the current mode instead of cycling it.
+	 */
+	rt5683_mode_lock(rt5683);
+	rt5683->streams[substream->stream]--;
+	if (substream->stream == SNDRV_PCM_STREAM_CAPTURE)
+		rt5683->cap_voice[dai->id] = false;
+	else
+		rt5683->play_open[dai->id] = false;
+	rt5683_mode_unlock(rt5683);
+	mod_delayed_work(system_power_efficient_wq, &rt5683->profile_work,
+		msecs_to_jiffies(rtd->pmdown_time));
+}
+
+static const struct snd_soc_dai_ops rt5683_aif1_dai_ops = {
+	.startup = rt5683_dai_startup,
+	.shutdown = rt5683_dai_shutdown,
+	.hw_params = rt5683_aif1_hw_params,
+	.hw_free = rt5683_aif1_hw_free,
+	.set_fmt = rt5683_set_dai_fmt,
+	.set_tdm_slot = rt5683_set_tdm_slot,
+};
+
+static const struct snd_soc_dai_ops rt5683_aif2_dai_ops = {
+	.startup = rt5683_dai_startup,
+	.shutdown = rt5683_dai_shutdown,
+	.hw_params = rt5683_aif2_hw_params,
+	.set_fmt = rt5683_set_dai_fmt,
+	.set_tdm_slot = rt5683_set_tdm_slot,
+};
 
 static struct snd_soc_dai_driver rt5683_dai[] = {
 	{
@@ -654,16 +2507,17 @@ static struct snd_soc_dai_driver rt5683_dai[] = {
 			.stream_name = "AIF1 Playback",
 			.channels_min = 1,
 			.channels_max = 2,
-			.rates = RT5683_STEREO_RATES,
-			.formats = RT5683_FORMATS,
+			.rates = RT5683_AIF1_RATES,
+			.formats = RT5683_AIF1_FORMATS | RT5683_DSD_FORMATS,
 		},
 		.capture = {
 			.stream_name = "AIF1 Capture",
 			.channels_min = 1,
 			.channels_max = 2,
 			.rates = RT5683_STEREO_RATES,
-			.formats = RT5683_FORMATS,
+			.formats = RT5683_AIF1_FORMATS,
 		},
+		.ops = &rt5683_aif1_dai_ops,
 	},
 	{
 		.name = "rt5683-aif2",
@@ -682,11 +2536,13 @@ static struct snd_soc_dai_driver rt5683_dai[] = {
 			.rates = RT5683_STEREO_RATES,
 			.formats = RT5683_FORMATS,
 		},
+		.ops = &rt5683_aif2_dai_ops,
 	},
 };
 
 static const struct snd_soc_component_driver soc_component_dev_rt5683 = {
 	.probe = rt5683_probe,
+	.remove = rt5683_remove,
 	.suspend = rt5683_suspend,
 	.resume = rt5683_resume,
 	.controls = rt5683_snd_controls,
@@ -738,6 +2594,33 @@ static irqreturn_t rt5683_hs_btn_irq_handler(int irq, void *dev_id)
 {
 	struct rt5683_priv *rt5683  = dev_id;
 
+	/*
+	 * The storm fields are only touched here while the IRQ is enabled and
+	 * only by rt5683_storm_work() while it is masked.
+	 */
+	if (irq && rt5683->irq) {
+		if (time_after(jiffies, rt5683->storm_window + HZ)) {
+			rt5683->storm_window = jiffies;
+			rt5683->storm_edges = 0;
+		}
+
+		if (++rt5683->storm_edges > rt5683->storm_threshold) {
+			disable_irq_nosync(rt5683->irq);
+			rt5683->storm = true;
+			rt5683->storm_count++;
+			pr_warn("%s:JD IRQ storm, polling for %u ms\n",
+				__func__, rt5683->storm_cooldown_ms);
+			rt5683->poll_ms = RT5683_POLL_MAX_MS;
+			mod_delayed_work(system_power_efficient_wq,
+				&rt5683->jd_poll_work,
+				msecs_to_jiffies(RT5683_POLL_MAX_MS));
+			mod_delayed_work(system_power_efficient_wq,
+				&rt5683->storm_work,
+				msecs_to_jiffies(rt5683->storm_cooldown_ms));
+			return IRQ_HANDLED;
+		}
+	}
+
 	pr_info("%s:HS BTN IRQ detected!",__func__);
 	mod_delayed_work(system_power_efficient_wq,
 			&rt5683->hs_btn_detect_work, msecs_to_jiffies(30));
@@ -745,6 +2628,72 @@ static irqreturn_t rt5683_hs_btn_irq_handler(int irq, void *dev_id)
 	return IRQ_HANDLED;
 }
 
+/*
+ * Without a JD IRQ the JD status is polled instead: every RT5683_POLL_MIN_MS
+ * right after a plug or button event, backing off exponentially to
+ * RT5683_POLL_MAX_MS while nothing happens. Each poll costs one I2C read,
+ * two while a headset is plugged in.
+ */
+static void rt5683_jd_poll_work(struct work_struct *work)
+{
+	struct rt5683_priv *rt5683 =
+		container_of(work, struct rt5683_priv, jd_poll_work.work);
+	unsigned int val_00bd, val_00be = 0, reads = 1;
+	bool event;
+
+	regmap_read(rt5683->regmap, 0x00BD, &val_00bd);
+	event = (val_00bd & 0x30) != (READ_ONCE(rt5683->jd_status) & 0x30);
+
+	if (!event && READ_ONCE(rt5683->jack_type) == SND_JACK_HEADSET) {
+		regmap_read(rt5683->regmap, 0x00BE, &val_00be);
+		reads++;
+		event = val_00be & 0x80;
+	}
+
+	if (event) {
+		mod_delayed_work(system_power_efficient_wq,
+			&rt5683->hs_btn_detect_work, 0);
+		rt5683->poll_ms = RT5683_POLL_MIN_MS;
+	} else {
+		rt5683->poll_ms = min_t(unsigned int, rt5683->poll_ms * 2,
+			RT5683_POLL_MAX_MS);
+	}
+
+	/* A flapping jack is only looked at slowly until the IRQ is back */
+	if (READ_ONCE(rt5683->storm))
+		rt5683->poll_ms = RT5683_POLL_MAX_MS;
+
+	spin_lock(&rt5683->state_lock);
+	rt5683->poll_count++;
+	rt5683->poll_reads += reads;
+	if (event)
+		rt5683->poll_events++;
+	spin_unlock(&rt5683->state_lock);
+
+	if (rt5683->jd_poll || READ_ONCE(rt5683->storm))
+		queue_delayed_work(system_power_efficient_wq,
+			&rt5683->jd_poll_work,
+			msecs_to_jiffies(rt5683->poll_ms));
+}
+
+/* End of the storm cool-down: unmask the JD IRQ and resync the jack */
+static void rt5683_storm_work(struct work_struct *work)
+{
+	struct rt5683_priv *rt5683 =
+		container_of(work, struct rt5683_priv, storm_work.work);
+
+	if (!rt5683->storm)
+		return;
+
+	rt5683->storm_edges = 0;
+	rt5683->storm_window = jiffies;
+	WRITE_ONCE(rt5683->storm, false);
+	enable_irq(rt5683->irq);
+
+	mod_delayed_work(system_power_efficient_wq,
+		&rt5683->hs_btn_detect_work, 0);
+}
+
 int rt5683_set_jack_detect(struct snd_soc_component *component,
 	struct snd_soc_jack *hs_jack)
 {
@@ -752,6 +2701,12 @@ int rt5683_set_jack_detect(struct snd_soc_component *component,
 
 	rt5683->hs_jack = hs_jack;
 	rt5683_hs_btn_irq_handler(0, rt5683);
+	if (rt5683->jd_poll) {
+		rt5683->poll_ms = RT5683_POLL_MIN_MS;
+		mod_delayed_work(system_power_efficient_wq,
+			&rt5683->jd_poll_work,
+			msecs_to_jiffies(RT5683_POLL_MIN_MS));
+	}
 
 	return 0;
 }
@@ -824,23 +2779,57 @@ void rt5683_sar_adc_button_det(struct snd_soc_component *component)
 	msleep(50);
 }
 
+/*
+ * SAR-ADC arming takes ~100 ms, so it runs here after the jack type has
+ * already been reported. Button IRQs seen while arming are replayed once
+ * arming is done.
+ */
+static void rt5683_sar_arm_work(struct work_struct *work)
+{
+	struct rt5683_priv *rt5683 =
+		container_of(work, struct rt5683_priv, sar_arm_work);
+
+	rt5683_sar_adc_button_det(rt5683->component);
+	/*
+	 * Armed in-line detect runs on the 0x0065/0x0214 bits alone, as it
+	 * did in power saving mode; VREF/MBIAS, MICBIAS, the OSC and
+	 * EN_IBUF_CBJ_BST1 were only needed for classification and arming.
+	 */
+	rt5683_jd_pwr_set(rt5683, 0x0062, 0x00);
+	rt5683_jd_pwr_set(rt5683, 0x0063, 0x00);
+	rt5683_jd_pwr_set(rt5683, 0x0068, 0x00);
+	rt5683_jd_pwr_set(rt5683, 0x2B05, 0x00);
+	/* Keep the flags latched by a press during arming for the replay */
+	if (!test_bit(RT5683_BTN_PENDING, &rt5683->jd_flags)) {
+		regmap_write(rt5683->regmap, 0x070c, 0xff);
+		regmap_write(rt5683->regmap, 0x070d, 0xff);
+	}
+
+	clear_bit(RT5683_SAR_ARMING, &rt5683->jd_flags);
+	smp_mb__after_atomic();
+	if (test_and_clear_bit(RT5683_BTN_PENDING, &rt5683->jd_flags))
+		mod_delayed_work(system_power_efficient_wq,
+			&rt5683->hs_btn_detect_work, 0);
+}
+
 int rt5683_headset_detect(struct snd_soc_component *component)
 {
 	struct rt5683_priv *rt5683 = snd_soc_component_get_drvdata(component);
 	int jack_type, val_2b03, sleep_loop=4;
 	int i = 0, sleep_time[4] = {150, 100, 50, 25};
 
-	regmap_update_bits(rt5683->regmap, 0x0068, 0x3, 0x03);
-	regmap_write(rt5683->regmap, 0x0063, 0xFE);
-	regmap_update_bits(rt5683->regmap, 0x0065, 0xE0, 0xE0);
+	rt5683_jd_pwr_set(rt5683, 0x0068, 0x03);
+	rt5683_jd_pwr_set(rt5683, 0x0063, 0xFE);
+	rt5683_jd_pwr_set(rt5683, 0x0065, 0xE0);
 	regmap_update_bits(rt5683->regmap, 0x0090, 0xC, 0x0);
-	regmap_update_bits(rt5683->regmap, 0x0214, 0x18, 0x18);
-	regmap_write(rt5683->regmap, 0x2B05, 0x80);
+	rt5683_jd_pwr_set(rt5683, 0x0214, 0x18);
+	regmap_update_bits(rt5683->regmap, 0x2B05, 0x7F, 0x00);
+	rt5683_jd_pwr_set(rt5683, 0x2B05, 0x80);
 	regmap_write(rt5683->regmap, 0x2B02, 0x0C);
 	regmap_write(rt5683->regmap, 0x2B03, 0x44);
 	regmap_write(rt5683->regmap, 0x2B01, 0x00);
-	regmap_write(rt5683->regmap, 0x0062, 0x0C);
-	regmap_write(rt5683->regmap, 0x0063, 0xAE);
+	rt5683_jd_pwr_set(rt5683, 0x0062, 0x0C);
+	rt5683_jd_pwr_set(rt5683, 0x0063, 0xAE);
 	regmap_write(rt5683->regmap, 0x2B00, 0xD0);
 	regmap_write(rt5683->regmap, 0x2B03, 0x44);
 	regmap_write(rt5683->regmap, 0x0011, 0x80);
@@ -869,7 +2858,8 @@ int rt5683_headset_detect(struct snd_soc_component *component)
 	else
 		jack_type = SND_JACK_HEADPHONE;
 
-	rt5683_sar_adc_button_det(rt5683->component);
+	set_bit(RT5683_SAR_ARMING, &rt5683->jd_flags);
+	queue_work(system_power_efficient_wq, &rt5683->sar_arm_work);
 	pr_info("val_2b03:0x%x, jack_type=%s\n",val_2b03,(jack_type == SND_JACK_HEADSET)?"HEADSET":"HEADPHONE");
 	return jack_type;
 }
@@ -882,7 +2872,17 @@ void rt5683_irq_interrupt_event(struct work_struct *work)
 	unsigned int val_00bd;
 	unsigned int val_00be,val_070c,val_070d;
 	int report=0, i, btn_type=0, jd_is_changed=0;
-	
+	ktime_t start;
+
+	if (test_bit(RT5683_JD_REMOVED, &rt5683->jd_flags))
+		return;
+
+	/* A brownout shows up as a JD edge as well */
+	mod_delayed_work(system_power_efficient_wq, &rt5683->recover_work, 0);
+
+	mutex_lock(&rt5683->jd_lock);
+	start = ktime_get();
+
 	for(i=0;i<3;i++){
 		msleep(1);
 		regmap_read(rt5683->regmap, 0x00BD, &val_00bd);
@@ -898,11 +2898,27 @@ void rt5683_irq_interrupt_event(struct work_struct *work)
 	/* JD Status Confirm */
 	if (((val_00bd & 0x30)==0x0)){
 		
-		if (jd_is_changed)
+		if (jd_is_changed) {
 			rt5683->jack_type = rt5683_headset_detect(rt5683->component);
-		
+			/* Only a headset mic needs bias for buttons */
+			if (rt5683->jack_type != SND_JACK_HEADSET) {
+				rt5683_jd_pwr_set(rt5683, 0x0062, 0x00);
+				rt5683_jd_pwr_set(rt5683, 0x0063, 0x00);
+			}
+		}
+
 		report = rt5683->jack_type;
-		regmap_update_bits(rt5683->regmap, 0x0214, 0x2, 0x2);
+
+		/* Button flags are not valid until SAR-ADC arming is done */
+		if (!jd_is_changed) {
+			set_bit(RT5683_BTN_PENDING, &rt5683->jd_flags);
+			smp_mb__after_atomic();
+			if (test_bit(RT5683_SAR_ARMING, &rt5683->jd_flags))
+				goto out;
+			clear_bit(RT5683_BTN_PENDING, &rt5683->jd_flags);
+		}
+
+		rt5683_jd_pwr_set(rt5683, 0x0214, 0x1A);
 		regmap_read(rt5683->regmap, 0x00BE, &val_00be);
 		regmap_read(rt5683->regmap, 0x070C, &val_070c);
 		regmap_read(rt5683->regmap, 0x070D, &val_070d);
@@ -924,24 +2940,45 @@ void rt5683_irq_interrupt_event(struct work_struct *work)
 		}
 	} else{
 		pr_info("Unplug!\n");
+		cancel_work_sync(&rt5683->sar_arm_work);
+		clear_bit(RT5683_SAR_ARMING, &rt5683->jd_flags);
+		clear_bit(RT5683_BTN_PENDING, &rt5683->jd_flags);
 		regmap_write(rt5683->regmap, 0x070c, 0xff);
 		regmap_write(rt5683->regmap, 0x070d, 0xff);
 		regmap_update_bits(rt5683->regmap, 0x3300, 0x80, 0x0);
+		rt5683_jd_pwr_set(rt5683, 0x0062, 0x00);
+		rt5683_jd_pwr_set(rt5683, 0x0063, 0x00);
+		rt5683_jd_pwr_set(rt5683, 0x0068, 0x00);
+		rt5683_jd_pwr_set(rt5683, 0x2B05, 0x00);
 		rt5683->jack_type = 0;
 		report = 0;
 	}
 
+	rt5683_pwr_stats_update(rt5683);
+	rt5683_lock_stat_add(rt5683, &rt5683->jd_stat, start);
+	mutex_unlock(&rt5683->jd_lock);
+
 	snd_soc_jack_report(rt5683->hs_jack, report, SND_JACK_HEADSET |
 		SND_JACK_BTN_0 | SND_JACK_BTN_1 | SND_JACK_BTN_2 |
 		SND_JACK_BTN_3);
+	return;
+
+out:
+	rt5683_lock_stat_add(rt5683, &rt5683->jd_stat, start);
+	mutex_unlock(&rt5683->jd_lock);
+}
+
+static void rt5683_stop_action(void *data)
+{
+	rt5683_stop(data);
 }
 
 static int rt5683_i2c_probe(struct i2c_client *i2c,
 		    const struct i2c_device_id *id)
 {
 	struct rt5683_priv *rt5683;
-	unsigned int irq_num;
-	int ret;
+	unsigned int irq_num, val;
+	int i, ret;
 
 	rt5683 = devm_kzalloc(&i2c->dev, sizeof(struct rt5683_priv),
 				GFP_KERNEL);
@@ -949,6 +2986,7 @@ static int rt5683_i2c_probe(struct i2c_client *i2c,
 		return -ENOMEM;
 
 	i2c_set_clientdata(i2c, rt5683);
+	rt5683->i2c = i2c;
 
 	rt5683->regmap = devm_regmap_init_i2c(i2c, &rt5683_regmap);
 	if (IS_ERR(rt5683->regmap)) {
@@ -958,14 +2996,74 @@ static int rt5683_i2c_probe(struct i2c_client *i2c,
 		return ret;
 	}
 
+	mutex_init(&rt5683->mode_lock);
+	mutex_init(&rt5683->jd_lock);
+	mutex_init(&rt5683->pwr_lock);
+	spin_lock_init(&rt5683->state_lock);
+	for (i = 0; i < RT5683_PWR_REGS; i++)
+		regmap_read(rt5683->regmap, rt5683_pwr_regs[i],
+			&rt5683->pwr_mode[i]);
+
+	rt5683->dre_stamp = ktime_get_boottime();
+	if (!device_property_read_u32(&i2c->dev, "realtek,hp-load", &val) &&
+		val <= RT5683_HP_LOAD_HIGH)
+		rt5683->hp_load = val;
+
+	rt5683->voice_rate = 1;
+	if (!device_property_read_u32(&i2c->dev, "realtek,voice-capture-rate",
+		&val)) {
+		for (i = 0; i < ARRAY_SIZE(rt5683_voice_rates); i++)
+			if (rt5683_voice_rates[i] == val)
+				rt5683->voice_rate = i;
+	}
+
+	rt5683->supply_uv = 1800000;
+	device_property_read_u32(&i2c->dev, "realtek,supply-microvolt",
+		&rt5683->supply_uv);
+	if (device_property_read_u32_array(&i2c->dev,
+		"realtek,pwr-block-microamp", rt5683->blk_ua,
+		RT5683_PWR_BLOCKS))
+		memset(rt5683->blk_ua, 0, sizeof(rt5683->blk_ua));
+	rt5683_pwr_stats_update(rt5683);
+	for (i = 0; i < RT5683_PWR_BLOCKS; i++)
+		rt5683->blk_stat[i].transitions = 0;
+	if (!device_property_read_u32(&i2c->dev, "realtek,dre-mode", &val) &&
+		val <= RT5683_DRE_GAIN_SUPPLY) {
+		rt5683->dre_mode = val;
+		rt5683_dre_apply(rt5683);
+	}
+
 	INIT_DELAYED_WORK(&rt5683->hs_btn_detect_work, rt5683_irq_interrupt_event);
+	INIT_WORK(&rt5683->sar_arm_work, rt5683_sar_arm_work);
+	INIT_DELAYED_WORK(&rt5683->vol_ramp_work, rt5683_vol_ramp_work);
+	INIT_DELAYED_WORK(&rt5683->recover_work, rt5683_recover_work);
+	INIT_DELAYED_WORK(&rt5683->jd_poll_work, rt5683_jd_poll_work);
+	INIT_DELAYED_WORK(&rt5683->storm_work, rt5683_storm_work);
+	INIT_DELAYED_WORK(&rt5683->profile_work, rt5683_profile_work);
+
+	rt5683->storm_threshold = RT5683_STORM_THRESHOLD;
+	rt5683->storm_cooldown_ms = RT5683_STORM_COOLDOWN_MS;
+	device_property_read_u32(&i2c->dev, "realtek,jd-storm-threshold",
+		&rt5683->storm_threshold);
+	device_property_read_u32(&i2c->dev, "realtek,jd-storm-cooldown-ms",
+		&rt5683->storm_cooldown_ms);
+	rt5683->storm_window = jiffies;
 
 	irq_num = gpio_to_irq(JACK_BTN_IRQ_GPIO);
-	ret = request_irq(irq_num, rt5683_hs_btn_irq_handler,
+	ret = devm_request_irq(&i2c->dev, irq_num, rt5683_hs_btn_irq_handler,
 		IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING | IRQF_ONESHOT,
 			"5683_JDH", rt5683);
-	if (ret < 0)
-		dev_err(&i2c->dev, "JD IRQ request failed!\n");
+	if (ret < 0) {
+		dev_err(&i2c->dev, "JD IRQ request failed, polling JD\n");
+		rt5683->jd_poll = true;
+	} else {
+		rt5683->irq = irq_num;
+	}
+
+	/* Covers a component that was never bound to a card */
+	ret = devm_add_action_or_reset(&i2c->dev, rt5683_stop_action, rt5683);
+	if (ret)
+		return ret;
 	
 	return devm_snd_soc_register_component(&i2c->dev,
 			&soc_component_dev_rt5683,
@@ -38,10 +38,18 @@
 #define RT5683_ADC_STO1_MIX_2			0x0023
 #define RT5683_STO_DAC_SRC_SEL			0x0027
 #define RT5683_STO_ADC_SRC_SEL			0x0028
+#define RT5683_TDM_CTRL_1			0x0030
+#define RT5683_TDM_AIF1_RX_SLOT			0x0031
+#define RT5683_TDM_AIF2_RX_SLOT			0x0032
+#define RT5683_TDM_AIF1_TX_SLOT			0x0033
+#define RT5683_TDM_AIF2_TX_SLOT			0x0034
+#define RT5683_I2S1_SDP				0x0039
+#define RT5683_I2S2_SDP				0x003a
 #define RT5683_L_CH_VOL_DAC			0x071a
 #define RT5683_R_CH_VOL_DAC			0x071b
 #define RT5683_L_CH_VOL_ADC			0x0e03
 #define RT5683_R_CH_VOL_ADC			0x0e04
+#define RT5683_BUCK_CTRL			0x0109
 #define RT5683_HP_SIG_SRC_CTRL			0x01db
 #define RT5683_SIL_DET				0x1b05
 #define RT5683_PHY_CTRL_27			0x401a
@@ -53,6 +61,92 @@
 #define ByRegister                    0x02
 #define SilenceDetect                 0x03
 
+/* HP Amp Control 1 (0x0001) */
+#define RT5683_HP_AMP_BIAS_MASK			(0xff << 0)
+#define RT5683_HP_AMP_BIAS_NORMAL		(0x88 << 0)
+#define RT5683_HP_AMP_BIAS_LOW			(0x44 << 0)
+
+/* HP Amp Control 3 (0x0003) */
+#define RT5683_CP_MODE_MASK			(0x3 << 4)
+#define RT5683_CP_MODE_NORMAL			(0x2 << 4)
+#define RT5683_CP_MODE_LOW			(0x1 << 4)
+
+/* HP Amp L/R DRE Control (0x0005/0x0006) */
+#define RT5683_DRE_EN_MASK			(0x1 << 7)
+#define RT5683_DRE_EN				(0x1 << 7)
+#define RT5683_DRE_DIS				(0x0 << 7)
+#define RT5683_DRE_SUP_MASK			(0x1 << 6)
+#define RT5683_DRE_SUP_EN			(0x1 << 6)
+#define RT5683_DRE_SUP_DIS			(0x0 << 6)
+
+/* Stereo1 DAC Mixer Control 1 (0x001a) */
+#define RT5683_STO_DAC_AIF1_L_SFT		7
+#define RT5683_STO_DAC_AIF1_R_SFT		6
+#define RT5683_STO_DAC_AIF2_L_SFT		5
+#define RT5683_STO_DAC_AIF2_R_SFT		4
+
+/* Stereo1 DAC Mixer Control 2 (0x001b) */
+#define RT5683_STO_DAC_ST_L_SFT			7
+#define RT5683_STO_DAC_ST_R_SFT			6
+#define RT5683_STO_DAC_ST_GAIN_SFT		4
+#define RT5683_STO_DAC_AIF2_GAIN_SFT		2
+#define RT5683_STO_DAC_AIF1_GAIN_SFT		0
+
+/* DSD/ANC Digital Mixer Control 1 (0x001c) */
+#define RT5683_DMIX_DACL_SRC_MASK		(0x3 << 6)
+#define RT5683_DMIX_DACL_SRC_PCM		(0x1 << 6)
+#define RT5683_DMIX_DACL_SRC_DSD		(0x2 << 6)
+#define RT5683_DMIX_DACR_SRC_MASK		(0x3 << 4)
+#define RT5683_DMIX_DACR_SRC_PCM		(0x1 << 4)
+#define RT5683_DMIX_DACR_SRC_DSD		(0x2 << 4)
+
+/* TDM Control 1 (0x0030) */
+#define RT5683_TDM_EN_MASK			(0x1 << 7)
+#define RT5683_TDM_EN				(0x1 << 7)
+#define RT5683_TDM_DIS				(0x0 << 7)
+#define RT5683_TDM_AIF2_SHARE_MASK		(0x1 << 6)
+#define RT5683_TDM_AIF2_SHARE			(0x1 << 6)
+#define RT5683_TDM_AIF2_SEP			(0x0 << 6)
+#define RT5683_TDM_SLOT_NUM_MASK		(0x3 << 4)
+#define RT5683_TDM_SLOT_NUM_SFT			4
+#define RT5683_TDM_SLOT_WIDTH_MASK		(0x3 << 2)
+#define RT5683_TDM_SLOT_WIDTH_SFT		2
+
+/* TDM Slot Select (0x0031 - 0x0034) */
+#define RT5683_TDM_SLOT_L_MASK			(0x7 << 4)
+#define RT5683_TDM_SLOT_L_SFT			4
+#define RT5683_TDM_SLOT_R_MASK			(0x7 << 0)
+#define RT5683_TDM_SLOT_R_SFT			0
+
+/* I2S1/I2S2 Serial Data Port (0x0039/0x003a) */
+#define RT5683_I2S_MS_MASK			(0x1 << 7)
+#define RT5683_I2S_MS_M				(0x1 << 7)
+#define RT5683_I2S_MS_S				(0x0 << 7)
+#define RT5683_I2S_BP_MASK			(0x1 << 6)
+#define RT5683_I2S_BP_INV			(0x1 << 6)
+#define RT5683_I2S_BP_NOR			(0x0 << 6)
+#define RT5683_I2S_DF_MASK			(0x3 << 0)
+#define RT5683_I2S_DF_I2S			(0x0 << 0)
+#define RT5683_I2S_DF_LEFT			(0x1 << 0)
+#define RT5683_I2S_DF_PCM_A			(0x2 << 0)
+#define RT5683_I2S_DF_PCM_B			(0x3 << 0)
+
+/* Buck Control (0x0109) */
+#define RT5683_BUCK_SEL_MASK			(0x7 << 4)
+#define RT5683_BUCK_1P95V			(0x4 << 4)
+#define RT5683_BUCK_1P8V			(0x3 << 4)
+
+enum {
+	RT5683_HP_LOAD_AUTO,
+	RT5683_HP_LOAD_LOW,
+	RT5683_HP_LOAD_HIGH,
+};
+
+enum {
+	RT5683_DRE_OFF,
+	RT5683_DRE_GAIN,
+	RT5683_DRE_GAIN_SUPPLY,
+};
 
 
 